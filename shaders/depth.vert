@@ -0,0 +1,38 @@
+#version 450
+
+layout(binding = 0) uniform UniformBuffer {
+    mat4 cameraView;
+    mat4 cameraProj;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+} uniforms;
+
+// rewritten only after a node moves, indexed by firstInstance
+struct Transform {
+    mat4 model;
+    mat4 normal;
+    uint material;
+    float alphaCutoff;
+};
+
+layout(std430, binding = 2) readonly buffer Transforms {
+    Transform transforms[];
+};
+
+layout(location = 0) in vec3 pos;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) flat out float alphaCutoff;
+
+// must match vertex.vert bit for bit, the color pass tests depth for equality
+invariant gl_Position;
+
+void main() {
+    vec4 worldPos = transforms[gl_InstanceIndex].model * vec4(pos, 1.0);
+    vec4 vertPos = uniforms.cameraView * worldPos;
+    gl_Position = uniforms.cameraProj * vertPos;
+    fragUv = uv;
+    alphaCutoff = transforms[gl_InstanceIndex].alphaCutoff;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 cameraView;
+    mat4 cameraProj;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    vec4 qualityParams;
+} uniforms;
+
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
+
+layout(location = 0) in vec2 uv;
+layout(location = 1) flat in float alphaCutoff;
+
+// same alpha test as fragment.frag, lod bias included, depth only
+void main() {
+    if (texture(texSampler, uv, uniforms.qualityParams.y).a < alphaCutoff)
+        discard;
+}
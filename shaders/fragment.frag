@@ -7,7 +7,42 @@ const float Kd = 0.6;
 const float Ks = 0.2;
 const float ambient = 0.6;
 
-layout(set = 0, binding = 1) uniform sampler2D shadowMap;
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 cameraView;
+    mat4 cameraProj;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+    // x share of the shadow map rendered, y texture lod bias
+    vec4 qualityParams;
+    // x y pixels per cluster tile, z w log depth to slice scale and bias
+    vec4 clusterParams;
+    // x point and spot lights
+    uvec4 lightParams;
+} uniforms;
+
+layout(set = 0, binding = 1) uniform sampler2DArrayShadow shadowMap;
+
+struct Light {
+    // xyz world position, w range
+    vec4 position;
+    // rgb color times intensity, w spot cone scale
+    vec4 color;
+    // xyz world direction, w spot cone offset
+    vec4 direction;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Lights {
+    Light lights[];
+};
+
+// per cluster a count then up to maxClusterLights light indices, see cluster_lights.comp
+layout(std430, set = 0, binding = 4) readonly buffer Clusters {
+    uint clusterLights[];
+};
+
+const uvec3 clusterGrid = uvec3(16, 9, 24);
+const uint maxClusterLights = 127;
 layout(set = 1, binding = 0) uniform sampler2D texSampler;
 layout(set = 1, binding = 1) uniform sampler2D normalSampler;
 
@@ -15,55 +50,93 @@ layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec2 uv;
 layout(location = 3) in vec3 vertexNormal;
-layout(location = 4) in float useNormalTexture;
+// the material's, per draw
+layout(location = 4) flat in float alphaCutoff;
 layout(location = 5) in vec3 lightDir;
-layout(location = 6) in vec4 shadowPos;
+layout(location = 6) in vec4 worldPos;
 
 layout(location = 0) out vec4 outColor;
 
-float getShadow(vec3 normal, vec2 offset)
+// pos is in view space, cascades split on view depth
+uint getCascade()
 {
-	vec2 shadowUv = ((shadowPos.xyz / shadowPos.w) * 0.5 + 0.5).xy;
-
-    float shadowMapDepth = texture(shadowMap, shadowUv + offset).r;
-	float shadowCoordDepth = shadowPos.z / shadowPos.w;
-//	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+	uint cascade = 0;
+	for (uint i = 0; i < 3; i++) {
+		if (-pos.z > uniforms.cascadeSplits[i])
+			cascade = i + 1;
+	}
+	return cascade;
+}
 
-	if (shadowCoordDepth - 0.0001 < shadowMapDepth)
-		return 1.0;
-	else
-		return ambient;
+// variant constants, disabled paths compile out
+// shadowFilter: 0 = 4 taps, 1 = 9 taps, 2 = 16 tap poisson disk
+layout(constant_id = 0) const uint shadowFilter = 1u;
+layout(constant_id = 1) const bool normalMap = true;
+layout(constant_id = 2) const bool alphaTest = true;
+layout(constant_id = 3) const bool shadows = false;
+
+const vec2 poissonDisk[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+	vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+	vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+	vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+	vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+// each tap is a bilinear filtered hardware compare, 1 = lit
+float getShadow(vec3 shadowCoord, float cascade, vec2 offset)
+{
+	return texture(shadowMap, vec4(shadowCoord.xy + offset, cascade, shadowCoord.z));
 }
 
 float pcf(vec3 normal)
 {
-	ivec2 texDim = textureSize(shadowMap, 0);
-	float scale = 1.0;
-	float dx = scale * 1.0 / float(texDim.x);
-	float dy = scale * 1.0 / float(texDim.y);
-
-	float shadowFactor = 0.0;
-	int count = 0;
-	int range = 1;
-	
-	for (int x = -range; x <= range; x++)
-	{
-		for (int y = -range; y <= range; y++)
-		{
-			shadowFactor += getShadow(normal, vec2(dx*x, dy*y));
-			count++;
-		}
-	
+	uint cascade = getCascade();
+	vec4 shadowPos = uniforms.cascadeViewProj[cascade] * worldPos;
+	vec3 shadowCoord = vec3((shadowPos.xy / shadowPos.w) * 0.5 + 0.5, shadowPos.z / shadowPos.w - 0.0001);
+//	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+
+	// a lowered resolution only renders the top left corner, outside it reads as lit like the
+	// border and the taps stay clear of its edge
+	float share = uniforms.qualityParams.x;
+	if (share < 1.0) {
+		if (any(greaterThan(abs(shadowCoord.xy - 0.5), vec2(0.5))))
+			return 1.0;
+		shadowCoord.xy = min(shadowCoord.xy * share, share - 2.0 * texel);
 	}
-	return shadowFactor / count;
+
+	if (shadowFilter == 0) {
+		// 2x2 bilinear taps, one texel either side of the center
+		for (int x = 0; x < 2; x++)
+			for (int y = 0; y < 2; y++)
+				lit += getShadow(shadowCoord, float(cascade), texel * vec2(x * 2 - 1, y * 2 - 1));
+		lit /= 4.0;
+	} else if (shadowFilter == 1) {
+		for (int x = -1; x <= 1; x++)
+			for (int y = -1; y <= 1; y++)
+				lit += getShadow(shadowCoord, float(cascade), texel * vec2(x, y));
+		lit /= 9.0;
+	} else {
+		for (int i = 0; i < 16; i++)
+			lit += getShadow(shadowCoord, float(cascade), texel * 1.5 * poissonDisk[i]);
+		lit /= 16.0;
+	}
+
+	return mix(ambient, 1.0, lit);
 }
 
 vec3 getNormal()
 {
-	if (useNormalTexture < 0.5)
+	if (!normalMap)
 		return vertexNormal;
 
-	vec3 tangentNormal = texture(normalSampler, uv).xyz * 2.0 - 1.0;
+	vec3 tangentNormal = texture(normalSampler, uv, uniforms.qualityParams.y).xyz * 2.0 - 1.0;
 
 	// Transform normals by perturbation
 	// http://www.thetenthplanet.de/archives/1180
@@ -79,9 +152,45 @@ vec3 getNormal()
 	return normalize(TBN * tangentNormal);
 }
 
+// point and spot lights of the fragment's cluster, unshadowed
+vec3 clusterLighting(vec3 normal, vec3 texColor)
+{
+	if (uniforms.lightParams.x == 0u)
+		return vec3(0.0);
+
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / uniforms.clusterParams.xy), clusterGrid.xy - 1u);
+	uint slice = uint(clamp(log(-pos.z) * uniforms.clusterParams.z + uniforms.clusterParams.w, 0.0, float(clusterGrid.z - 1u)));
+	uint base = ((slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x) * (maxClusterLights + 1);
+	uint count = clusterLights[base];
+
+	// camera position from the view matrix, lighting is in world space
+	mat3 viewRotation = mat3(uniforms.cameraView);
+	vec3 eye = -(transpose(viewRotation) * uniforms.cameraView[3].xyz);
+	vec3 viewDir = normalize(eye - worldPos.xyz);
+
+	vec3 lit = vec3(0.0);
+	for (uint i = 0; i < count; i++) {
+		Light light = lights[clusterLights[base + 1 + i]];
+		vec3 toLight = light.position.xyz - worldPos.xyz;
+		float distanceSquared = dot(toLight, toLight);
+		vec3 L = toLight * inversesqrt(max(distanceSquared, 1e-8));
+
+		// inverse square windowed to reach 0 at the range
+		float window = clamp(1.0 - pow(distanceSquared / (light.position.w * light.position.w), 2.0), 0.0, 1.0);
+		float attenuation = window * window / max(distanceSquared, 0.01);
+		float cone = clamp(dot(light.direction.xyz, -L) * light.color.w + light.direction.w, 0.0, 1.0);
+		attenuation *= cone * cone;
+
+		float diff = max(dot(normal, L), 0.0);
+		float spec = pow(max(dot(normal, normalize(L + viewDir)), 0.0), 16.0);
+		lit += light.color.rgb * attenuation * (Kd * diff * texColor + Ks * spec * specColor);
+	}
+	return lit;
+}
+
 void main() {
-	vec4 tex = texture(texSampler, uv);
-	if (tex.a < 0.5)
+	vec4 tex = texture(texSampler, uv, uniforms.qualityParams.y);
+	if (alphaTest && tex.a < alphaCutoff)
 		discard;
 
 	vec3 texColor = tex.rgb;
@@ -94,8 +203,7 @@ void main() {
     vec3 halfwayDir = normalize(lightDir + viewDir);  
     spec = pow(max(dot(normal, halfwayDir), 0.0), 16.0);
     vec3 specular = specColor * spec;
-//	float shadow = pcf(normal);
-	float shadow = 1.0;
+	float shadow = shadows ? pcf(normal) : 1.0;
 
-    outColor = shadow * vec4(Ka * ambient + Kd * diffuse + Ks * specular, 1.0);
+    outColor = shadow * vec4(Ka * ambient + Kd * diffuse + Ks * specular, 1.0) + vec4(clusterLighting(normal, texColor), 0.0);
 }
@@ -3,21 +3,28 @@
 layout(binding = 0) uniform UniformBuffer {
     mat4 cameraView;
     mat4 cameraProj;
-    mat4 lightView;
-    mat4 lightProj;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
     vec4 lightPos;
 } uniforms;
 
-layout(push_constant) uniform PushConstants {
+// rewritten only after a node moves, indexed by firstInstance
+struct Transform {
     mat4 model;
-    float useNormalTexture;
+    mat4 normal;
+    uint material;
+};
+
+layout(std430, binding = 2) readonly buffer Transforms {
+    Transform transforms[];
+};
+
+layout(push_constant) uniform PushConstants {
+    uint cascade;
 } constants;
 
 layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 color;
-layout(location = 3) in vec2 uv;
 
 void main() {
-    gl_Position = uniforms.lightProj * uniforms.lightView * constants.model * vec4(pos, 1.0);;
+    gl_Position = uniforms.cascadeViewProj[constants.cascade] * transforms[gl_InstanceIndex].model * vec4(pos, 1.0);
 }
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+layout(binding = 0) uniform UniformBuffer {
+    mat4 cameraView;
+    mat4 cameraProj;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 lightPos;
+} uniforms;
+
+// rewritten only after a node moves, indexed by firstInstance
+struct Transform {
+    mat4 model;
+    mat4 normal;
+    uint material;
+};
+
+layout(std430, binding = 2) readonly buffer Transforms {
+    Transform transforms[];
+};
+
+layout(location = 0) in vec3 pos;
+
+// one view per cascade, all drawn in a single pass
+void main() {
+    gl_Position = uniforms.cascadeViewProj[gl_ViewIndex] * transforms[gl_InstanceIndex].model * vec4(pos, 1.0);
+}
@@ -3,15 +3,22 @@
 layout(binding = 0) uniform UniformBuffer {
     mat4 cameraView;
     mat4 cameraProj;
-    mat4 lightView;
-    mat4 lightProj;
-	vec4 lightPos;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 lightPos;
 } uniforms;
 
-layout(push_constant) uniform PushConstants {
+// rewritten only after a node moves, indexed by firstInstance
+struct Transform {
     mat4 model;
-    float useNormalTexture;
-} constants;
+    mat4 normal;
+    uint material;
+    float alphaCutoff;
+};
+
+layout(std430, binding = 2) readonly buffer Transforms {
+    Transform transforms[];
+};
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 normal;
@@ -22,20 +29,21 @@ layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragColor;
 layout(location = 2) out vec2 fragUv;
 layout(location = 3) out vec3 vertNormal;
-layout(location = 4) out float useNormalTexture;
+layout(location = 4) flat out float alphaCutoff;
 layout(location = 5) out vec3 lightDir;
-layout(location = 6) out vec4 shadowCoord;
+layout(location = 6) out vec4 worldPos;
+
+invariant gl_Position;
 
 void main() {
-    vec4 vertPos = uniforms.cameraView * constants.model * vec4(pos, 1.0);
+    Transform transform = transforms[gl_InstanceIndex];
+    worldPos = transform.model * vec4(pos, 1.0);
+    vec4 vertPos = uniforms.cameraView * worldPos;
     gl_Position = uniforms.cameraProj * vertPos;
-//    vec4 vertPos = uniforms.lightView * constants.model * vec4(pos, 1.0);
-//    gl_Position = uniforms.lightProj * vertPos;
     fragPos = vec3(vertPos) / vertPos.w;
     fragColor = color;
     fragUv = uv;
-    vertNormal = normalize(transpose(inverse(mat3(constants.model))) * normal);
-    useNormalTexture = constants.useNormalTexture;
+    vertNormal = normalize(mat3(transform.normal) * normal);
+    alphaCutoff = transform.alphaCutoff;
     lightDir = normalize(vec3(uniforms.lightPos));
-    shadowCoord = uniforms.lightProj * uniforms.lightView * constants.model * vec4(pos, 1.0);    
 }
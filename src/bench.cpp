@@ -0,0 +1,187 @@
+#include "engine.hpp"
+#include "gltf.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Loader micro benchmarks: palace_bench [filter]
+// only cases whose name contains filter run, the gpu cases need a device (lavapipe will do)
+
+using namespace pl;
+
+namespace {
+
+// keeps results alive so the measured work isn't optimized away
+volatile uint64_t sink;
+
+using Run = std::function<void()>;
+
+struct BenchCase {
+    std::string name;
+    // bytes touched by one iteration, for throughput
+    size_t bytes;
+    // sets up the inputs and returns one iteration, gpu cases get the memory helper of a headless engine
+    std::function<Run(MemoryHelper*)> prepare;
+    bool isGpu { false };
+};
+
+// repeats run until minSeconds pass, returns the mean ns per iteration
+double measure(const Run& run, double minSeconds = 0.2)
+{
+    using Clock = std::chrono::steady_clock;
+    run();
+    uint64_t iterations = 1;
+    while (true) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            run();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= minSeconds)
+            return seconds * 1e9 / (double)iterations;
+        iterations *= seconds < minSeconds / 10.0 ? 10 : 2;
+    }
+}
+
+void report(const BenchCase& benchCase, double ns)
+{
+    if (benchCase.bytes > 0)
+        printf("%-40s %14.1f ns %10.2f GB/s\n", benchCase.name.c_str(), ns, (double)benchCase.bytes / ns);
+    else
+        printf("%-40s %14.1f ns\n", benchCase.name.c_str(), ns);
+}
+
+std::vector<float> randomFloats(size_t count)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::vector<float> floats(count);
+    for (auto& _float : floats)
+        _float = value(random);
+    return floats;
+}
+
+template <typename T>
+std::vector<unsigned char> randomIndices(size_t count, size_t vertexCount)
+{
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> index(0, vertexCount - 1);
+    std::vector<unsigned char> data(count * sizeof(T));
+    for (size_t i = 0; i < count; i++) {
+        T value = static_cast<T>(index(random));
+        memcpy(&data[i * sizeof(T)], &value, sizeof(T));
+    }
+    return data;
+}
+
+// about the size of the largest Sponza primitives
+constexpr size_t sVertexCount = 1 << 16;
+constexpr size_t sIndexCount = 3 * sVertexCount;
+
+Run interleaveCase(MemoryHelper*)
+{
+    auto positions = std::make_shared<std::vector<float>>(randomFloats(sVertexCount * 3));
+    auto normals = std::make_shared<std::vector<float>>(randomFloats(sVertexCount * 3));
+    auto texCoords = std::make_shared<std::vector<float>>(randomFloats(sVertexCount * 2));
+    return [=] {
+        std::vector<Vertex> vertices;
+        interleaveVertices(positions->data(), normals->data(), texCoords->data(), glm::vec4(1.0f), sVertexCount, vertices);
+        sink = sink + vertices.size();
+    };
+}
+
+template <typename T>
+Run rebaseCase(int componentType)
+{
+    auto data = std::make_shared<std::vector<unsigned char>>(randomIndices<T>(sIndexCount, std::min<size_t>(sVertexCount, size_t(1) << (8 * sizeof(T)))));
+    return [=] {
+        std::vector<uint32_t> indices;
+        rebaseIndices(data->data(), sIndexCount, componentType, 1024, indices);
+        sink = sink + indices.back();
+    };
+}
+
+// a chain of nodes, the deepest one walks every ancestor
+Run globalMatrixCase(size_t depth)
+{
+    auto nodes = std::make_shared<std::vector<Node>>(depth);
+    for (size_t i = 0; i < depth; i++) {
+        Node& node = (*nodes)[i];
+        node.parent = i > 0 ? &(*nodes)[i - 1] : nullptr;
+        node.mesh = nullptr;
+        node.translation = glm::vec3(1.0f, 0.0f, 0.0f);
+        node.rotation = glm::angleAxis(0.1f, glm::vec3(0.0f, 1.0f, 0.0f));
+        node.scale = glm::vec3(1.01f);
+    }
+    return [=] {
+        glm::mat4 m = nodes->back().getGlobalMatrix();
+        sink = sink + static_cast<uint64_t>(m[3][0]);
+    };
+}
+
+Run uploadCase(MemoryHelper* memoryHelper, size_t size)
+{
+    auto src = std::make_shared<std::vector<unsigned char>>(size, 0x5a);
+    auto buffer = memoryHelper->createBuffer(size, vk::BufferUsageFlagBits::eTransferDst, 0);
+    return [=] {
+        memoryHelper->uploadToBuffer(buffer, src->data());
+    };
+}
+
+// staging copy, upload and mip chain of a loaded texture
+Run textureCase(MemoryHelper* memoryHelper, uint32_t extent)
+{
+    size_t size = size_t(extent) * extent * 4;
+    auto src = std::make_shared<std::vector<unsigned char>>(size, 0x5a);
+    auto mipLevels = static_cast<uint32_t>(std::floor(std::log2(extent))) + 1;
+    return [=] {
+        auto image = memoryHelper->createTextureImage(src->data(), size, { extent, extent, 1 }, mipLevels);
+        memoryHelper->destroyImage(image);
+    };
+}
+
+std::vector<BenchCase> benchCases()
+{
+    std::vector<BenchCase> cases;
+    cases.push_back({ "interleaveVertices/65536", sVertexCount * sizeof(Vertex), interleaveCase });
+    cases.push_back({ "rebaseIndices/u32/196608", sIndexCount * sizeof(uint32_t), [](MemoryHelper*) { return rebaseCase<uint32_t>(TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT); } });
+    cases.push_back({ "rebaseIndices/u16/196608", sIndexCount * sizeof(uint32_t), [](MemoryHelper*) { return rebaseCase<uint16_t>(TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT); } });
+    cases.push_back({ "rebaseIndices/u8/196608", sIndexCount * sizeof(uint32_t), [](MemoryHelper*) { return rebaseCase<uint8_t>(TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE); } });
+    for (size_t depth : { 4, 16, 64 }) {
+        cases.push_back({ "Node::getGlobalMatrix/depth" + std::to_string(depth), 0, [=](MemoryHelper*) { return globalMatrixCase(depth); } });
+    }
+    for (size_t size : { size_t(4) << 10, size_t(256) << 10, size_t(4) << 20, size_t(64) << 20 }) {
+        cases.push_back({ "MemoryHelper::uploadToBuffer/" + std::to_string(size >> 10) + "k", size, [=](MemoryHelper* memoryHelper) { return uploadCase(memoryHelper, size); }, true });
+    }
+    for (uint32_t extent : { 256u, 1024u, 2048u }) {
+        cases.push_back({ "MemoryHelper::createTextureImage/" + std::to_string(extent), size_t(extent) * extent * 4, [=](MemoryHelper* memoryHelper) { return textureCase(memoryHelper, extent); }, true });
+    }
+    return cases;
+}
+
+}
+
+int main(const int argc, const char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    // vulkan only comes up once a gpu case is selected
+    std::unique_ptr<Engine> engine;
+    for (const auto& _case : benchCases()) {
+        if (filter && _case.name.find(filter) == std::string::npos)
+            continue;
+        if (_case.isGpu && !engine) {
+            engine = std::make_unique<Engine>();
+            engine->init({ .enableValidation = false, .headless = true });
+        }
+        report(_case, measure(_case.prepare(engine ? engine->memoryHelper() : nullptr)));
+    }
+
+    return 0;
+}
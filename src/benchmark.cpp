@@ -0,0 +1,243 @@
+#include "benchmark.hpp"
+
+#include "frame_stats.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace pl {
+
+Benchmark::Benchmark(const BenchmarkCreateInfo& createInfo)
+    : warmupFrames_(createInfo.warmupFrames)
+    , frameCount_(std::max(createInfo.frameCount, 1u))
+    , reportPath_(createInfo.reportPath)
+    , budgetMs_(createInfo.budgetMs)
+    , gpuLatency_(createInfo.gpuLatency)
+{
+    // orbit around the scene, alternating between wide views and passes through the middle
+    glm::vec3 sceneCenter = 0.5f * (createInfo.sceneMin + createInfo.sceneMax);
+    glm::vec3 halfExtent = glm::max(0.5f * (createInfo.sceneMax - createInfo.sceneMin), glm::vec3(0.5f));
+    constexpr uint32_t keyCount = 8;
+
+    for (uint32_t i = 0; i < keyCount; i++) {
+        float angle = 2.0f * 3.14159265f * (float)i / (float)keyCount;
+        float radius = (i % 2 == 0) ? 0.9f : 0.3f;
+        float height = (i % 2 == 0) ? 0.6f : -0.5f;
+        glm::vec3 eye = sceneCenter + glm::vec3(std::cos(angle) * radius * halfExtent.x, height * halfExtent.y, std::sin(angle) * radius * halfExtent.z);
+        glm::vec3 center = (i % 2 == 0) ? sceneCenter : sceneCenter + glm::vec3(-std::sin(angle) * halfExtent.x, -0.5f * halfExtent.y, std::cos(angle) * halfExtent.z);
+        path_.push_back({ eye, center });
+    }
+
+    samples_.reserve(frameCount_);
+}
+
+void Benchmark::cameraPose(glm::vec3& eye, glm::vec3& center) const
+{
+    // warmup frames sit at the start of the path
+    uint32_t measured = frame_ > warmupFrames_ ? frame_ - warmupFrames_ : 0;
+    float t = (float)measured / (float)frameCount_ * (float)path_.size();
+    size_t key = static_cast<size_t>(t) % path_.size();
+    float f = t - std::floor(t);
+
+    // uniform catmull-rom through the keys, closed loop
+    auto spline = [&](auto member) {
+        const glm::vec3& p0 = path_[(key + path_.size() - 1) % path_.size()].*member;
+        const glm::vec3& p1 = path_[key].*member;
+        const glm::vec3& p2 = path_[(key + 1) % path_.size()].*member;
+        const glm::vec3& p3 = path_[(key + 2) % path_.size()].*member;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * f + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * f * f + (3.0f * p1 - p0 - 3.0f * p2 + p3) * f * f * f);
+    };
+    eye = spline(&CameraKey::eye);
+    center = spline(&CameraKey::center);
+}
+
+void Benchmark::record(const FrameSample& sample)
+{
+    // the cpu side belongs to this frame, the gpu times to the frame gpuLatency_ before it
+    if (frame_ >= warmupFrames_ && samples_.size() < frameCount_) {
+        samples_.push_back(sample);
+        samples_.back().gpuMs = 0.0;
+        samples_.back().gpuZones.clear();
+    }
+    if (frame_ >= warmupFrames_ + gpuLatency_ && gpuSamples_ < samples_.size()) {
+        samples_[gpuSamples_].gpuMs = sample.gpuMs;
+        samples_[gpuSamples_].gpuZones = sample.gpuZones;
+        gpuSamples_++;
+    }
+    frame_++;
+}
+
+FrameStatistics Benchmark::statistics(std::vector<double> values)
+{
+    FrameStatistics stats {};
+    if (values.empty())
+        return stats;
+
+    std::sort(values.begin(), values.end());
+    stats.min = values.front();
+    stats.max = values.back();
+    stats.mean = std::accumulate(values.begin(), values.end(), 0.0) / (double)values.size();
+    stats.p50 = nearestRankPercentile(values, 0.50);
+    stats.p95 = nearestRankPercentile(values, 0.95);
+    stats.p99 = nearestRankPercentile(values, 0.99);
+    return stats;
+}
+
+FrameStatistics Benchmark::cpuStatistics() const
+{
+    std::vector<double> values(samples_.size());
+    std::transform(samples_.begin(), samples_.end(), values.begin(), [](const FrameSample& sample) { return sample.cpuMs; });
+    return statistics(std::move(values));
+}
+
+FrameStatistics Benchmark::gpuStatistics() const
+{
+    // a stopped run has no gpu times for its last frames
+    std::vector<double> values(gpuSamples_);
+    std::transform(samples_.begin(), samples_.begin() + gpuSamples_, values.begin(), [](const FrameSample& sample) { return sample.gpuMs; });
+    return statistics(std::move(values));
+}
+
+FrameStatistics Benchmark::gpuZoneStatistics(const char* name) const
+{
+    std::vector<double> values;
+    for (const auto& _sample : samples_) {
+        for (const auto& _zone : _sample.gpuZones) {
+            if (strcmp(_zone.name, name) == 0)
+                values.push_back(_zone.ms);
+        }
+    }
+    return statistics(std::move(values));
+}
+
+std::vector<const char*> Benchmark::gpuZoneNames() const
+{
+    std::vector<const char*> names;
+    for (const auto& _sample : samples_) {
+        for (const auto& _zone : _sample.gpuZones) {
+            bool isKnown = std::any_of(names.begin(), names.end(), [&](const char* _name) { return strcmp(_name, _zone.name) == 0; });
+            if (!isKnown)
+                names.push_back(_zone.name);
+        }
+    }
+    return names;
+}
+
+bool Benchmark::writeCsv(const std::string& path) const
+{
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open())
+        return false;
+
+    // one column per gpu pass, empty where a frame did not run the pass
+    std::vector<const char*> zoneNames = gpuZoneNames();
+    stream << "frame,cpu_ms,gpu_ms,draws,triangles,binds";
+    for (const char* _name : zoneNames)
+        stream << ",gpu_" << _name << "_ms";
+    stream << "\n";
+
+    char line[128];
+    for (size_t i = 0; i < samples_.size(); i++) {
+        const FrameSample& sample = samples_[i];
+        snprintf(line, sizeof(line), "%zu,%.4f,%.4f,%u,%llu,%u", i, sample.cpuMs, sample.gpuMs, sample.draws, (unsigned long long)sample.triangles, sample.binds);
+        stream << line;
+        for (const char* _name : zoneNames) {
+            stream << ",";
+            for (const auto& _zone : sample.gpuZones) {
+                if (strcmp(_zone.name, _name) == 0) {
+                    snprintf(line, sizeof(line), "%.4f", _zone.ms);
+                    stream << line;
+                }
+            }
+        }
+        stream << "\n";
+    }
+    return static_cast<bool>(stream);
+}
+
+bool Benchmark::writeJson(const std::string& path) const
+{
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open())
+        return false;
+
+    char line[256];
+    auto writeStatistics = [&](const char* indent, const char* name, const FrameStatistics& stats, const char* separator) {
+        snprintf(line, sizeof(line), "%s\"%s\": { \"min\": %.4f, \"max\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }%s\n",
+            indent, name, stats.min, stats.max, stats.mean, stats.p50, stats.p95, stats.p99, separator);
+        stream << line;
+    };
+
+    FrameStatistics cpu = cpuStatistics();
+    stream << "{\n";
+    snprintf(line, sizeof(line), "  \"warmup_frames\": %u,\n  \"frames\": %zu,\n  \"budget_ms\": %.4f,\n  \"passed\": %s,\n",
+        warmupFrames_, samples_.size(), budgetMs_, isComplete() && isWithinBudget() ? "true" : "false");
+    stream << line;
+    writeStatistics("  ", "cpu_ms", cpu, ",");
+    writeStatistics("  ", "gpu_ms", gpuStatistics(), ",");
+
+    std::vector<const char*> zoneNames = gpuZoneNames();
+    stream << "  \"gpu_passes_ms\": {\n";
+    for (size_t i = 0; i < zoneNames.size(); i++)
+        writeStatistics("    ", zoneNames[i], gpuZoneStatistics(zoneNames[i]), i + 1 < zoneNames.size() ? "," : "");
+    stream << "  },\n";
+
+    stream << "  \"samples\": [\n";
+    for (size_t i = 0; i < samples_.size(); i++) {
+        const FrameSample& sample = samples_[i];
+        snprintf(line, sizeof(line), "    { \"cpu_ms\": %.4f, \"gpu_ms\": %.4f, \"draws\": %u, \"triangles\": %llu, \"binds\": %u }%s\n",
+            sample.cpuMs, sample.gpuMs, sample.draws, (unsigned long long)sample.triangles, sample.binds, i + 1 < samples_.size() ? "," : "");
+        stream << line;
+    }
+    stream << "  ]\n}\n";
+    return static_cast<bool>(stream);
+}
+
+bool Benchmark::writeReport()
+{
+    isReportWritten_ = writeCsv(reportPath_ + ".csv") && writeJson(reportPath_ + ".json");
+    if (!isReportWritten_) {
+        LOG_ERROR("Failed to write benchmark report.", "BENCH");
+        return false;
+    }
+
+    if (!isComplete()) {
+        char line[96];
+        snprintf(line, sizeof(line), "Benchmark stopped after %zu of %u frames.", samples_.size(), frameCount_);
+        LOG_WARN(line, "BENCH");
+    }
+
+    FrameStatistics cpu = cpuStatistics();
+    FrameStatistics gpu = gpuStatistics();
+    printf("%zu frames, cpu p50 %.2f p95 %.2f p99 %.2f ms, gpu p50 %.2f p95 %.2f p99 %.2f ms\n",
+        samples_.size(), cpu.p50, cpu.p95, cpu.p99, gpu.p50, gpu.p95, gpu.p99);
+    return true;
+}
+
+bool Benchmark::isWithinBudget() const
+{
+    return budgetMs_ <= 0.0 || cpuStatistics().p95 <= budgetMs_;
+}
+
+int Benchmark::exitStatus() const
+{
+    // a partial run says nothing about the budget, its percentiles may come from no frames at all
+    if (!isComplete())
+        return 3;
+    if (!isWithinBudget())
+        return 1;
+    if (!isReportWritten_)
+        return 2;
+    return 0;
+}
+
+UniqueBenchmark createBenchmarkUnique(const BenchmarkCreateInfo& createInfo)
+{
+    return std::make_unique<Benchmark>(createInfo);
+}
+
+}
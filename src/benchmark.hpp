@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gpu_profiler.hpp"
+#include "types.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pl {
+
+struct FrameSample {
+    // cpu wall time of the whole frame
+    double cpuMs;
+    // gpu time between the first and last command, the profiler reads it back gpuLatency
+    // frames late and the benchmark files it under the frame it measured
+    double gpuMs;
+    uint32_t draws;
+    // cpu recorded draws only, indirect draw counts are decided on the gpu
+    uint64_t triangles;
+    uint32_t binds;
+    // per pass gpu times, filed like gpuMs
+    std::vector<GpuZoneTime> gpuZones;
+};
+
+struct FrameStatistics {
+    double min {}, max {}, mean {};
+    double p50 {}, p95 {}, p99 {};
+};
+
+struct BenchmarkCreateInfo {
+    uint32_t warmupFrames { 100 };
+    uint32_t frameCount { 1000 };
+    // written as <reportPath>.csv with the raw samples and <reportPath>.json with the summary
+    std::string reportPath { "benchmark" };
+    // p95 cpu frame time a run must not exceed, 0 disables the check
+    double budgetMs { 0.0 };
+    // the camera path orbits through these bounds
+    glm::vec3 sceneMin { -1.0f };
+    glm::vec3 sceneMax { 1.0f };
+    // frames between recording a frame and reading back its gpu times
+    uint32_t gpuLatency { 0 };
+};
+
+// Flies a fixed camera path over a fixed number of frames and reports frame time percentiles.
+// Warmup frames hold the camera at the start of the path and are not recorded, so pipelines
+// and caches settle first. The run goes gpuLatency frames past the last measured one so the
+// gpu times of every measured frame are read back.
+class Benchmark {
+public:
+    explicit Benchmark(const BenchmarkCreateInfo& createInfo);
+
+    // camera for the current frame, the path loops once over the measured frames
+    void cameraPose(glm::vec3& eye, glm::vec3& center) const;
+    void record(const FrameSample& sample);
+    bool finished() const { return frame_ >= warmupFrames_ + frameCount_ + gpuLatency_; }
+
+    FrameStatistics cpuStatistics() const;
+    FrameStatistics gpuStatistics() const;
+    // frames without the pass are left out
+    FrameStatistics gpuZoneStatistics(const char* name) const;
+    // false when either report could not be written
+    bool writeReport();
+    // 0 passed, 1 over budget, 2 no report, 3 stopped before every frame was recorded
+    int exitStatus() const;
+
+private:
+    struct CameraKey {
+        glm::vec3 eye;
+        glm::vec3 center;
+    };
+
+    static FrameStatistics statistics(std::vector<double> values);
+    bool isComplete() const { return gpuSamples_ >= frameCount_; }
+    bool isWithinBudget() const;
+    // every pass in any sample, first seen first
+    std::vector<const char*> gpuZoneNames() const;
+    bool writeCsv(const std::string& path) const;
+    bool writeJson(const std::string& path) const;
+
+    uint32_t warmupFrames_;
+    uint32_t frameCount_;
+    std::string reportPath_;
+    double budgetMs_;
+    uint32_t gpuLatency_;
+    std::vector<CameraKey> path_;
+
+    uint32_t frame_ {};
+    std::vector<FrameSample> samples_;
+    // the leading samples that have their gpu times
+    size_t gpuSamples_ {};
+    bool isReportWritten_ {};
+};
+
+using UniqueBenchmark = std::unique_ptr<Benchmark>;
+
+UniqueBenchmark createBenchmarkUnique(const BenchmarkCreateInfo& createInfo);
+
+}
@@ -0,0 +1,289 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace pl {
+
+namespace {
+
+    constexpr float sInfinity = std::numeric_limits<float>::max();
+
+    glm::vec3 itemMin(const BoundsSoA& bounds, uint32_t i)
+    {
+        return { bounds.minX[i], bounds.minY[i], bounds.minZ[i] };
+    }
+
+    glm::vec3 itemMax(const BoundsSoA& bounds, uint32_t i)
+    {
+        return { bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i] };
+    }
+
+    float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 e = max - min;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    // -1 outside, 0 intersecting, 1 inside
+    int classify(const glm::vec4& plane, const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 positive { plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z };
+        glm::vec3 negative { plane.x > 0.0f ? min.x : max.x, plane.y > 0.0f ? min.y : max.y, plane.z > 0.0f ? min.z : max.z };
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            return -1;
+        if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f)
+            return 1;
+        return 0;
+    }
+
+    // slab test, returns the entry distance or sInfinity on a miss
+    float intersect(const glm::vec3& origin, const glm::vec3& invDirection, const glm::vec3& min, const glm::vec3& max, float tmax)
+    {
+        glm::vec3 t0 = (min - origin) * invDirection;
+        glm::vec3 t1 = (max - origin) * invDirection;
+        glm::vec3 tnear = glm::min(t0, t1);
+        glm::vec3 tfar = glm::max(t0, t1);
+        float entry = std::max(std::max(tnear.x, tnear.y), std::max(tnear.z, 0.0f));
+        float exit = std::min(std::min(tfar.x, tfar.y), std::min(tfar.z, tmax));
+        return entry <= exit ? entry : sInfinity;
+    }
+
+}
+
+void Bvh::build(const BoundsSoA& bounds)
+{
+    const auto count = static_cast<uint32_t>(bounds.size());
+
+    nodes_.clear();
+    items_.resize(count);
+    std::iota(items_.begin(), items_.end(), 0);
+    if (count == 0)
+        return;
+
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++) {
+        centroids[i] = (itemMin(bounds, i) + itemMax(bounds, i)) * 0.5f;
+    }
+
+    // a binary tree over n leaves never exceeds 2n - 1 nodes
+    nodes_.reserve(2 * count);
+    nodes_.push_back({ .first = 0, .count = count });
+    updateBounds(nodes_[0], bounds);
+
+    std::vector<uint32_t> stack { 0 };
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        if (split(nodeIndex, bounds, centroids)) {
+            stack.push_back(nodes_[nodeIndex].first);
+            stack.push_back(nodes_[nodeIndex].first + 1);
+        }
+    }
+}
+
+bool Bvh::split(uint32_t nodeIndex, const BoundsSoA& bounds, const std::vector<glm::vec3>& centroids)
+{
+    BvhNode node = nodes_[nodeIndex];
+    if (node.count <= sMaxLeafSize)
+        return false;
+
+    glm::vec3 centroidMin { sInfinity };
+    glm::vec3 centroidMax { -sInfinity };
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        centroidMin = glm::min(centroidMin, centroids[items_[i]]);
+        centroidMax = glm::max(centroidMax, centroids[items_[i]]);
+    }
+
+    struct Bin {
+        glm::vec3 min { sInfinity };
+        glm::vec3 max { -sInfinity };
+        uint32_t count {};
+    };
+
+    float bestCost = sInfinity;
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        std::array<Bin, sBinCount> bins {};
+        float scale = static_cast<float>(sBinCount) / extent;
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t item = items_[i];
+            auto b = std::min(static_cast<uint32_t>((centroids[item][axis] - centroidMin[axis]) * scale), sBinCount - 1);
+            bins[b].count++;
+            bins[b].min = glm::min(bins[b].min, itemMin(bounds, item));
+            bins[b].max = glm::max(bins[b].max, itemMax(bounds, item));
+        }
+
+        std::array<float, sBinCount - 1> leftCost {};
+        Bin left;
+        for (uint32_t i = 0; i < sBinCount - 1; i++) {
+            left.count += bins[i].count;
+            left.min = glm::min(left.min, bins[i].min);
+            left.max = glm::max(left.max, bins[i].max);
+            leftCost[i] = left.count > 0 ? left.count * surfaceArea(left.min, left.max) : sInfinity;
+        }
+
+        Bin right;
+        for (uint32_t i = sBinCount - 1; i > 0; i--) {
+            right.count += bins[i].count;
+            right.min = glm::min(right.min, bins[i].min);
+            right.max = glm::max(right.max, bins[i].max);
+            if (right.count == 0 || leftCost[i - 1] == sInfinity)
+                continue;
+
+            float cost = leftCost[i - 1] + right.count * surfaceArea(right.min, right.max);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    // every centroid coincides, keep the items together
+    if (bestAxis < 0)
+        return false;
+
+    float scale = static_cast<float>(sBinCount) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    auto middle = std::partition(items_.begin() + node.first, items_.begin() + node.first + node.count, [&](uint32_t item) {
+        return std::min(static_cast<uint32_t>((centroids[item][bestAxis] - centroidMin[bestAxis]) * scale), sBinCount - 1) < bestSplit;
+    });
+    auto leftCount = static_cast<uint32_t>(middle - (items_.begin() + node.first));
+
+    auto leftIndex = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({ .first = node.first, .count = leftCount });
+    nodes_.push_back({ .first = node.first + leftCount, .count = node.count - leftCount });
+    updateBounds(nodes_[leftIndex], bounds);
+    updateBounds(nodes_[leftIndex + 1], bounds);
+
+    nodes_[nodeIndex].first = leftIndex;
+    nodes_[nodeIndex].count = 0;
+    return true;
+}
+
+void Bvh::updateBounds(BvhNode& node, const BoundsSoA& bounds) const
+{
+    node.min = glm::vec3 { sInfinity };
+    node.max = glm::vec3 { -sInfinity };
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        node.min = glm::min(node.min, itemMin(bounds, items_[i]));
+        node.max = glm::max(node.max, itemMax(bounds, items_[i]));
+    }
+}
+
+void Bvh::refit(const BoundsSoA& bounds)
+{
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        auto& node = nodes_[i];
+        if (node.count > 0) {
+            updateBounds(node, bounds);
+        } else {
+            const auto& left = nodes_[node.first];
+            const auto& right = nodes_[node.first + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+CullStats Bvh::cullFrustum(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visibility) const
+{
+    constexpr uint32_t allPlanes = (1u << 6) - 1;
+
+    visibility.assign(items_.size(), 0);
+    if (nodes_.empty())
+        return {};
+
+    uint32_t visible = 0;
+
+    // planes a box lies entirely inside of are dropped for its children
+    struct Entry {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+    std::vector<Entry> stack { { 0, allPlanes } };
+
+    while (!stack.empty()) {
+        auto [nodeIndex, planeMask] = stack.back();
+        stack.pop_back();
+        const auto& node = nodes_[nodeIndex];
+
+        bool outside = false;
+        for (uint32_t p = 0; p < 6 && !outside; p++) {
+            if (!(planeMask & (1u << p)))
+                continue;
+            int side = classify(frustum.planes[p], node.min, node.max);
+            outside = side < 0;
+            if (side > 0)
+                planeMask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        if (node.count == 0) {
+            stack.push_back({ node.first, planeMask });
+            stack.push_back({ node.first + 1, planeMask });
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t item = items_[i];
+            bool inside = true;
+            for (uint32_t p = 0; p < 6 && inside; p++) {
+                if (planeMask & (1u << p))
+                    inside = classify(frustum.planes[p], itemMin(bounds, item), itemMax(bounds, item)) >= 0;
+            }
+            visibility[item] = inside;
+            visible += inside;
+        }
+    }
+
+    return { visible, static_cast<uint32_t>(items_.size()) - visible };
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, const BoundsSoA& bounds, uint32_t& item, float& t) const
+{
+    if (nodes_.empty())
+        return false;
+
+    glm::vec3 invDirection = 1.0f / direction;
+    float closest = sInfinity;
+
+    std::vector<uint32_t> stack { 0 };
+    while (!stack.empty()) {
+        const auto& node = nodes_[stack.back()];
+        stack.pop_back();
+
+        if (intersect(origin, invDirection, node.min, node.max, closest) == sInfinity)
+            continue;
+
+        if (node.count == 0) {
+            // visit the nearer child first
+            float tl = intersect(origin, invDirection, nodes_[node.first].min, nodes_[node.first].max, closest);
+            float tr = intersect(origin, invDirection, nodes_[node.first + 1].min, nodes_[node.first + 1].max, closest);
+            stack.push_back(tl < tr ? node.first + 1 : node.first);
+            stack.push_back(tl < tr ? node.first : node.first + 1);
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            float hit = intersect(origin, invDirection, itemMin(bounds, items_[i]), itemMax(bounds, items_[i]), closest);
+            if (hit < closest) {
+                closest = hit;
+                item = items_[i];
+            }
+        }
+    }
+
+    t = closest;
+    return closest != sInfinity;
+}
+
+}
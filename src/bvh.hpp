@@ -0,0 +1,43 @@
+#pragma once
+
+#include "culling.hpp"
+#include "types.hpp"
+#include <vector>
+
+namespace pl {
+
+struct BvhNode {
+    glm::vec3 min;
+    uint32_t first; // first child when count == 0, else first item index
+    glm::vec3 max;
+    uint32_t count;
+};
+
+// Bounding volume hierarchy over a set of boxes, built with binned SAH.
+// Children are always stored after their parent, refit walks the nodes backwards.
+class Bvh {
+public:
+    void build(const BoundsSoA& bounds);
+    void refit(const BoundsSoA& bounds);
+
+    // queries take the same bounds the hierarchy was built or refit with
+    CullStats cullFrustum(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visibility) const;
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, const BoundsSoA& bounds, uint32_t& item, float& t) const;
+
+    bool empty() const { return nodes_.empty(); }
+    // bounds of everything, the hierarchy must not be empty
+    const BvhNode& root() const { return nodes_.front(); }
+    size_t nodeCount() const { return nodes_.size(); }
+
+private:
+    static constexpr uint32_t sBinCount = 16;
+    static constexpr uint32_t sMaxLeafSize = 4;
+
+    bool split(uint32_t nodeIndex, const BoundsSoA& bounds, const std::vector<glm::vec3>& centroids);
+    void updateBounds(BvhNode& node, const BoundsSoA& bounds) const;
+
+    std::vector<BvhNode> nodes_;
+    std::vector<uint32_t> items_;
+};
+
+}
@@ -0,0 +1,175 @@
+#include "culling.hpp"
+
+#include <bit>
+#include <cmath>
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace pl {
+
+Frustum extractFrustum(const glm::mat4& viewProj)
+{
+    // https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+    glm::mat4 m = glm::transpose(viewProj);
+    Frustum frustum {
+        .planes = {
+            m[3] + m[0],
+            m[3] - m[0],
+            m[3] + m[1],
+            m[3] - m[1],
+            m[2],
+            m[3] - m[2] }
+    };
+
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+void transformBounds(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax)
+{
+    // Arvo, Transforming Axis-Aligned Bounding Boxes, Graphics Gems 1990
+    glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::vec3 extent = (max - min) * 0.5f;
+    glm::vec3 worldExtent {};
+    for (int i = 0; i < 3; i++) {
+        worldExtent[i] = std::abs(transform[0][i]) * extent.x
+            + std::abs(transform[1][i]) * extent.y
+            + std::abs(transform[2][i]) * extent.z;
+    }
+    outMin = center - worldExtent;
+    outMax = center + worldExtent;
+}
+
+void BoundsSoA::resize(size_t count)
+{
+    for (auto* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+        v->resize(count);
+    }
+}
+
+void BoundsSoA::set(size_t i, const glm::vec3& min, const glm::vec3& max)
+{
+    minX[i] = min.x;
+    minY[i] = min.y;
+    minZ[i] = min.z;
+    maxX[i] = max.x;
+    maxY[i] = max.y;
+    maxZ[i] = max.z;
+}
+
+namespace {
+
+    // the box corner furthest along each plane normal, picked once per plane
+    struct PlaneCorner {
+        float nx, ny, nz, d;
+        const float *x, *y, *z;
+    };
+
+    std::array<PlaneCorner, 6> planeCorners(const Frustum& frustum, const BoundsSoA& bounds)
+    {
+        std::array<PlaneCorner, 6> corners;
+        for (size_t p = 0; p < 6; p++) {
+            const auto& plane = frustum.planes[p];
+            corners[p] = {
+                .nx = plane.x,
+                .ny = plane.y,
+                .nz = plane.z,
+                .d = plane.w,
+                .x = plane.x > 0.0f ? bounds.maxX.data() : bounds.minX.data(),
+                .y = plane.y > 0.0f ? bounds.maxY.data() : bounds.minY.data(),
+                .z = plane.z > 0.0f ? bounds.maxZ.data() : bounds.minZ.data()
+            };
+        }
+        return corners;
+    }
+
+    size_t cullScalar(const std::array<PlaneCorner, 6>& corners, size_t begin, size_t end, uint8_t* visibility)
+    {
+        size_t visible = 0;
+        for (size_t i = begin; i < end; i++) {
+            bool inside = true;
+            for (const auto& c : corners) {
+                inside &= c.nx * c.x[i] + c.ny * c.y[i] + c.nz * c.z[i] + c.d >= 0.0f;
+            }
+            visibility[i] = inside;
+            visible += inside;
+        }
+        return visible;
+    }
+
+#if defined(__AVX__)
+    constexpr size_t sLanes = 8;
+
+    size_t cullSimd(const std::array<PlaneCorner, 6>& corners, size_t count, uint8_t* visibility)
+    {
+        size_t visible = 0;
+        for (size_t i = 0; i + sLanes <= count; i += sLanes) {
+            __m256 outside = _mm256_setzero_ps();
+            for (const auto& c : corners) {
+                __m256 dist = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c.nx), _mm256_loadu_ps(c.x + i)),
+                        _mm256_mul_ps(_mm256_set1_ps(c.ny), _mm256_loadu_ps(c.y + i))),
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c.nz), _mm256_loadu_ps(c.z + i)),
+                        _mm256_set1_ps(c.d)));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+            int mask = ~_mm256_movemask_ps(outside) & 0xff;
+            for (size_t lane = 0; lane < sLanes; lane++) {
+                visibility[i + lane] = (mask >> lane) & 1;
+            }
+            visible += std::popcount(static_cast<unsigned>(mask));
+        }
+        return visible;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    constexpr size_t sLanes = 4;
+
+    size_t cullSimd(const std::array<PlaneCorner, 6>& corners, size_t count, uint8_t* visibility)
+    {
+        size_t visible = 0;
+        for (size_t i = 0; i + sLanes <= count; i += sLanes) {
+            __m128 outside = _mm_setzero_ps();
+            for (const auto& c : corners) {
+                __m128 dist = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c.nx), _mm_loadu_ps(c.x + i)),
+                        _mm_mul_ps(_mm_set1_ps(c.ny), _mm_loadu_ps(c.y + i))),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c.nz), _mm_loadu_ps(c.z + i)),
+                        _mm_set1_ps(c.d)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+            }
+            int mask = ~_mm_movemask_ps(outside) & 0xf;
+            for (size_t lane = 0; lane < sLanes; lane++) {
+                visibility[i + lane] = (mask >> lane) & 1;
+            }
+            visible += std::popcount(static_cast<unsigned>(mask));
+        }
+        return visible;
+    }
+#else
+    constexpr size_t sLanes = 1;
+
+    size_t cullSimd(const std::array<PlaneCorner, 6>& corners, size_t count, uint8_t* visibility)
+    {
+        return cullScalar(corners, 0, count, visibility);
+    }
+#endif
+
+}
+
+CullStats cullBounds(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visibility)
+{
+    const size_t count = bounds.size();
+    visibility.resize(count);
+
+    auto corners = planeCorners(frustum, bounds);
+    size_t simdCount = count - count % sLanes;
+    size_t visible = cullSimd(corners, simdCount, visibility.data());
+    visible += cullScalar(corners, simdCount, count, visibility.data());
+
+    return { static_cast<uint32_t>(visible), static_cast<uint32_t>(count - visible) };
+}
+
+}
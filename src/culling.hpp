@@ -0,0 +1,37 @@
+#pragma once
+
+#include "types.hpp"
+#include <array>
+#include <vector>
+
+namespace pl {
+
+// planes face inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+};
+
+Frustum extractFrustum(const glm::mat4& viewProj);
+
+// conservative world space bounds of a transformed box
+void transformBounds(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax);
+
+// axis aligned boxes stored as structure of arrays for the SIMD culling kernel
+struct BoundsSoA {
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    size_t size() const { return minX.size(); }
+    void resize(size_t count);
+    void set(size_t i, const glm::vec3& min, const glm::vec3& max);
+};
+
+struct CullStats {
+    uint32_t visible {};
+    uint32_t culled {};
+};
+
+// writes 1 to visibility[i] when box i intersects the frustum, 0 otherwise
+CullStats cullBounds(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visibility);
+
+}
@@ -0,0 +1,156 @@
+#include "draw.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace pl {
+
+uint32_t DrawKey::depthBucket(float viewDepth, float znear, float zfar)
+{
+    constexpr uint32_t maxBucket = (1u << sDepthBits) - 1;
+
+    if (viewDepth <= znear)
+        return 0;
+    if (viewDepth >= zfar)
+        return maxBucket;
+
+    float t = std::log(viewDepth / znear) / std::log(zfar / znear);
+    return static_cast<uint32_t>(t * static_cast<float>(maxBucket));
+}
+
+void sortDrawCalls(std::vector<DrawCall>& drawCalls, std::vector<DrawCall>& scratch)
+{
+    const size_t count = drawCalls.size();
+    if (count < 2)
+        return;
+
+    scratch.resize(count);
+
+    std::array<std::array<uint32_t, 256>, 8> histograms {};
+    for (const auto& _drawCall : drawCalls) {
+        for (uint32_t byte = 0; byte < 8; byte++) {
+            histograms[byte][(_drawCall.key >> (byte * 8)) & 0xff]++;
+        }
+    }
+
+    DrawCall* src = drawCalls.data();
+    DrawCall* dst = scratch.data();
+
+    for (uint32_t byte = 0; byte < 8; byte++) {
+        auto& histogram = histograms[byte];
+
+        // every key shares this byte, order is unchanged
+        if (histogram[(src[0].key >> (byte * 8)) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (auto& bucket : histogram) {
+            uint32_t n = bucket;
+            bucket = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            dst[histogram[(src[i].key >> (byte * 8)) & 0xff]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != drawCalls.data()) {
+        std::memcpy(drawCalls.data(), src, count * sizeof(DrawCall));
+    }
+}
+
+EncoderStats& EncoderStats::operator+=(const EncoderStats& other)
+{
+    draws += other.draws;
+    indirectDraws += other.indirectDraws;
+    triangles += other.triangles;
+    pipelineBinds += other.pipelineBinds;
+    descriptorBinds += other.descriptorBinds;
+    pushConstants += other.pushConstants;
+    skippedPipelineBinds += other.skippedPipelineBinds;
+    skippedDescriptorBinds += other.skippedDescriptorBinds;
+    skippedPushConstants += other.skippedPushConstants;
+    return *this;
+}
+
+CommandEncoder::CommandEncoder(vk::CommandBuffer commandBuffer)
+    : commandBuffer_(commandBuffer)
+{
+}
+
+void CommandEncoder::bindPipeline(vk::Pipeline pipeline)
+{
+    if (pipeline == pipeline_) {
+        stats_.skippedPipelineBinds++;
+        return;
+    }
+    commandBuffer_.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+    pipeline_ = pipeline;
+    stats_.pipelineBinds++;
+}
+
+void CommandEncoder::bindDescriptorSet(vk::PipelineLayout layout, uint32_t set, vk::DescriptorSet descriptorSet)
+{
+    if (set < sMaxDescriptorSets && setLayouts_[set] == layout && sets_[set] == descriptorSet) {
+        stats_.skippedDescriptorBinds++;
+        return;
+    }
+    commandBuffer_.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, set, 1, &descriptorSet, 0, nullptr);
+    stats_.descriptorBinds++;
+
+    // a different layout may disturb the sets that follow
+    for (uint32_t i = set; i < sMaxDescriptorSets; i++) {
+        if (setLayouts_[i] != layout) {
+            setLayouts_[i] = vk::PipelineLayout {};
+            sets_[i] = vk::DescriptorSet {};
+        }
+    }
+    if (set < sMaxDescriptorSets) {
+        setLayouts_[set] = layout;
+        sets_[set] = descriptorSet;
+    }
+}
+
+void CommandEncoder::pushConstants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t size, const void* data)
+{
+    if (layout == pushLayout_ && size == pushSize_ && std::memcmp(pushData_.data(), data, size) == 0) {
+        stats_.skippedPushConstants++;
+        return;
+    }
+    commandBuffer_.pushConstants(layout, stages, 0, size, data);
+    stats_.pushConstants++;
+
+    if (size <= sMaxPushConstantSize) {
+        pushLayout_ = layout;
+        pushSize_ = size;
+        std::memcpy(pushData_.data(), data, size);
+    } else {
+        pushLayout_ = vk::PipelineLayout {};
+    }
+}
+
+void CommandEncoder::drawIndexed(uint32_t indexCount, uint32_t firstIndex, uint32_t firstInstance)
+{
+    commandBuffer_.drawIndexed(indexCount, 1, firstIndex, 0, firstInstance);
+    stats_.draws++;
+    stats_.triangles += indexCount / 3;
+}
+
+void CommandEncoder::drawIndexedIndirectCount(vk::Buffer buffer, vk::DeviceSize offset, vk::Buffer countBuffer, vk::DeviceSize countOffset, uint32_t maxDraws, uint32_t stride)
+{
+    commandBuffer_.drawIndexedIndirectCountKHR(buffer, offset, countBuffer, countOffset, maxDraws, stride);
+    stats_.indirectDraws++;
+}
+
+void CommandEncoder::reset()
+{
+    pipeline_ = vk::Pipeline {};
+    setLayouts_.fill(vk::PipelineLayout {});
+    sets_.fill(vk::DescriptorSet {});
+    pushLayout_ = vk::PipelineLayout {};
+    pushSize_ = 0;
+}
+
+}
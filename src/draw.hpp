@@ -0,0 +1,85 @@
+#pragma once
+
+#include "types.hpp"
+#include <array>
+#include <vector>
+
+namespace pl {
+
+// 64-bit draw sort key, most significant field first:
+// | pass : 4 | pipeline : 12 | material : 24 | depth : 24 |
+namespace DrawKey {
+    constexpr uint32_t sPassBits = 4;
+    constexpr uint32_t sPipelineBits = 12;
+    constexpr uint32_t sMaterialBits = 24;
+    constexpr uint32_t sDepthBits = 24;
+
+    constexpr uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth)
+    {
+        return (uint64_t(pass & ((1u << sPassBits) - 1)) << (sPipelineBits + sMaterialBits + sDepthBits))
+            | (uint64_t(pipeline & ((1u << sPipelineBits) - 1)) << (sMaterialBits + sDepthBits))
+            | (uint64_t(material & ((1u << sMaterialBits) - 1)) << sDepthBits)
+            | uint64_t(depth & ((1u << sDepthBits) - 1));
+    }
+
+    constexpr uint32_t pass(uint64_t key) { return uint32_t(key >> (sPipelineBits + sMaterialBits + sDepthBits)); }
+    constexpr uint32_t pipeline(uint64_t key) { return uint32_t(key >> (sMaterialBits + sDepthBits)) & ((1u << sPipelineBits) - 1); }
+
+    // logarithmic view depth bucket, 0 = nearest
+    uint32_t depthBucket(float viewDepth, float znear, float zfar);
+}
+
+struct DrawCall {
+    uint64_t key;
+    uint32_t instance;
+};
+
+// stable LSD radix sort on DrawCall::key, skipping byte passes shared by every key
+void sortDrawCalls(std::vector<DrawCall>& drawCalls, std::vector<DrawCall>& scratch);
+
+struct EncoderStats {
+    uint32_t draws {};
+    uint32_t indirectDraws {};
+    // indexed draws only, indirect draw sizes are decided on the gpu
+    uint64_t triangles {};
+    uint32_t pipelineBinds {};
+    uint32_t descriptorBinds {};
+    uint32_t pushConstants {};
+    uint32_t skippedPipelineBinds {};
+    uint32_t skippedDescriptorBinds {};
+    uint32_t skippedPushConstants {};
+
+    EncoderStats& operator+=(const EncoderStats& other);
+};
+
+// Thin wrapper around vk::CommandBuffer that drops binds matching the current state.
+class CommandEncoder {
+public:
+    explicit CommandEncoder(vk::CommandBuffer commandBuffer);
+
+    void bindPipeline(vk::Pipeline pipeline);
+    void bindDescriptorSet(vk::PipelineLayout layout, uint32_t set, vk::DescriptorSet descriptorSet);
+    void pushConstants(vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t size, const void* data);
+    void drawIndexed(uint32_t indexCount, uint32_t firstIndex, uint32_t firstInstance = 0);
+    void drawIndexedIndirectCount(vk::Buffer buffer, vk::DeviceSize offset, vk::Buffer countBuffer, vk::DeviceSize countOffset, uint32_t maxDraws, uint32_t stride);
+    void reset();
+
+    vk::CommandBuffer commandBuffer() const { return commandBuffer_; }
+    const EncoderStats& stats() const { return stats_; }
+
+private:
+    static constexpr uint32_t sMaxDescriptorSets = 4;
+    static constexpr uint32_t sMaxPushConstantSize = 128;
+
+    vk::CommandBuffer commandBuffer_;
+    EncoderStats stats_;
+
+    vk::Pipeline pipeline_;
+    std::array<vk::PipelineLayout, sMaxDescriptorSets> setLayouts_ {};
+    std::array<vk::DescriptorSet, sMaxDescriptorSets> sets_ {};
+    vk::PipelineLayout pushLayout_;
+    uint32_t pushSize_ {};
+    std::array<uint8_t, sMaxPushConstantSize> pushData_ {};
+};
+
+}
@@ -1,13 +1,20 @@
 #include "engine.hpp"
 
+#include "culling.hpp"
 #include "log.hpp"
-#include "parser.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cfloat>
 #include <chrono>
 #include <fstream>
+#include <future>
+#include <numeric>
+#include <thread>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
-#define SHADOW_PASS false
 #define COLOR_PASS true
 
 VkBool32 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
@@ -54,6 +61,23 @@ std::vector<char> readSpirVFile(const std::string& spirVFile)
     return spirVBytes;
 }
 
+// rounds up to a multiple of granularity so small resizes still fit the images
+vk::Extent3D roundUpExtent(const vk::Extent3D& extent, uint32_t granularity)
+{
+    return vk::Extent3D {
+        (extent.width + granularity - 1) / granularity * granularity,
+        (extent.height + granularity - 1) / granularity * granularity,
+        1
+    };
+}
+
+// an image allocated at capacity holds extent and doesn't leave over half of itself unused
+bool isExtentReusable(const vk::Extent3D& capacity, const vk::Extent3D& extent)
+{
+    return extent.width <= capacity.width && extent.height <= capacity.height
+        && 2 * uint64_t(extent.width) * extent.height >= uint64_t(capacity.width) * capacity.height;
+}
+
 namespace pl {
 
 Engine::Engine()
@@ -62,28 +86,78 @@ Engine::Engine()
 
 Engine::~Engine()
 {
-    ImGui_ImplVulkan_Shutdown();
-    SDL_DestroyWindow(window_);
+    if (!isHeadless_)
+        ImGui_ImplVulkan_Shutdown();
+    if (window_)
+        SDL_DestroyWindow(window_);
     SDL_Quit();
 }
 
-void Engine::init(bool enableValidation)
+void Engine::init(const EngineCreateInfo& createInfo)
 {
-    isValidationEnabled_ = enableValidation;
+    isValidationEnabled_ = createInfo.enableValidation;
+    isGpuDriven_ = createInfo.gpuDriven;
+    isOcclusionCulling_ = createInfo.occlusionCulling;
+    isDepthPrepass_ = createInfo.depthPrepass;
+    isShadowPass_ = createInfo.shadows;
+    shadowFilter_ = createInfo.shadowFilter;
+    renderScale_ = std::clamp(createInfo.renderScale, 0.25f, 1.0f);
+    // the governor lowers the render scale, so it always renders through the upscaler
+    isRenderScaled_ = renderScale_ < 1.0f || createInfo.governorTargetMs > 0.0;
+    antiAliasing_ = createInfo.antiAliasing;
+    isSceneOffscreen_ = isRenderScaled_ || antiAliasing_ == AntiAliasing::Post;
+    isHeadless_ = createInfo.headless;
+    isBenchmark_ = createInfo.benchmark;
+    frameCount_ = createInfo.frameCount;
+    if ((isHeadless_ || isBenchmark_) && frameCount_ == 0)
+        frameCount_ = sHeadlessFrameCount_;
+    benchmarkInfo_ = {
+        .warmupFrames = createInfo.warmupFrames,
+        .reportPath = createInfo.reportPath,
+        .budgetMs = createInfo.budgetMs
+    };
+    isTraceOnExit_ = !createInfo.tracePath.empty();
+    tracePath_ = isTraceOnExit_ ? createInfo.tracePath : "trace.json";
+
+    // the configured quality tops the ladder, every level below gives up a little more,
+    // without shadows only the scale and lod bias steps are left
+    if (createInfo.governorTargetMs > 0.0) {
+        auto level = [&](float scale, uint32_t shadowResolution, ShadowFilter filter, float lodBias) {
+            if (!isShadowPass_)
+                return QualityLevel { std::min(scale, renderScale_), sShadowResolution_, shadowFilter_, lodBias };
+            return QualityLevel { std::min(scale, renderScale_), std::min<uint32_t>(shadowResolution, sShadowResolution_), std::min(filter, shadowFilter_), lodBias };
+        };
+        governor_ = createFrameGovernorUnique({ .targetMs = createInfo.governorTargetMs,
+            .levels = {
+                level(1.0f, sShadowResolution_, ShadowFilter::Poisson, 0.0f),
+                level(0.85f, sShadowResolution_, ShadowFilter::Pcf9, 0.0f),
+                level(0.75f, 1024, ShadowFilter::Pcf9, 0.5f),
+                level(0.67f, 1024, ShadowFilter::Pcf4, 0.5f),
+                level(0.5f, 768, ShadowFilter::Pcf4, 1.0f),
+                level(0.4f, 512, ShadowFilter::Pcf4, 1.0f) } });
+    }
 
     createInstance();
     createDevice();
+    msaaSamples_ = sampleCount(antiAliasing_);
     createCommandBuffers();
     createMemoryHelper();
+    createPipelineCache();
     createShadowPassResources();
     createDescriptorLayouts();
     createRenderPass();
     createPipelines();
+    if (isSceneOffscreen_)
+        createUpscaler();
+    createLightClusters();
     createStorageBuffers();
     createSwapchain();
     createGpuSync();
-    initImGui();
+    createGpuProfiler();
+    if (!isHeadless_)
+        initImGui();
     initCamera();
+    frameStats_ = createFrameStatsUnique(FrameStatsCreateInfo {});
 
     isInitialized_ = true;
 }
@@ -91,9 +165,28 @@ void Engine::init(bool enableValidation)
 void Engine::loadGltfModel(const char* path)
 {
     model_ = pl::createGltfModelUnique({ path, memoryHelper_.get() });
+    createSceneResources();
+}
+
+void Engine::loadStressScene(const StressSceneCreateInfo& createInfo)
+{
+    tinygltf::Model model = generateStressScene(createInfo);
+    model_ = pl::createGltfModelUnique({ "", memoryHelper_.get(), &model });
+    createSceneResources();
+}
+
+void Engine::createSceneResources()
+{
     if (!model_->complete)
         return;
 
+    // the indirect path has no overlay layer and redraws every caster when any moved
+    if (isShadowPass_ && model_->hasDynamicInstances && !isGpuDriven_)
+        createShadowCacheResources();
+    if (isGpuDriven_)
+        createGpuDrivenResources();
+    createTransformBuffers();
+    createLightBuffers();
     createDescriptorPool();
     createDescriptorSets();
 
@@ -110,8 +203,17 @@ void Engine::run()
         LOG_ERROR("Failed to run: no scene loaded.", "GFX");
         return;
     }
+    if (isBenchmark_) {
+        runBenchmark();
+        return;
+    }
+    if (isHeadless_) {
+        runHeadless();
+        return;
+    }
 
     bool quit = false;
+    uint32_t frame = 0;
     ticks = SDL_GetTicks64();
 
     glm::ivec4 wasd {};
@@ -125,127 +227,132 @@ void Engine::run()
 
     const Uint8* keyStates = SDL_GetKeyboardState(nullptr);
 
-    while (!quit) {
+    float elapsed = 0.0f;
+    while (!quit && (frameCount_ == 0 || frame < frameCount_)) {
+        PL_PROFILE_ZONE("Engine::frame");
         Uint64 start = SDL_GetPerformanceCounter();
         dt = SDL_GetTicks64() - ticks;
         ticks += dt;
 
         center = { extent_.width / 2, extent_.height / 2 };
 
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            switch (event.type) {
-
-            case SDL_QUIT:
-                quit = true;
-                break;
+        {
+            PL_PROFILE_ZONE("Engine::events");
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {
+                ImGui_ImplSDL2_ProcessEvent(&event);
+                switch (event.type) {
 
-            case SDL_WINDOWEVENT:
-                switch (event.window.event) {
-                case SDL_WINDOWEVENT_RESIZED:
-                    isResized_ = true;
+                case SDL_QUIT:
+                    quit = true;
                     break;
-                }
-                break;
 
-            case SDL_MOUSEBUTTONDOWN:
-                switch (event.button.button) {
-                case SDL_BUTTON_MIDDLE:
-                    camera_.reset();
-                    break;
-                case SDL_BUTTON_RIGHT:
-                    SDL_GetMouseState(&mouse_.x, &mouse_.y);
-                    SDL_SetRelativeMouseMode(SDL_TRUE);
-                    SDL_WarpMouseInWindow(window_, center.x, center.y);
+                case SDL_WINDOWEVENT:
+                    switch (event.window.event) {
+                    case SDL_WINDOWEVENT_RESIZED:
+                        isResized_ = true;
+                        break;
+                    }
                     break;
-                }
-                break;
 
-            case SDL_MOUSEBUTTONUP:
-                switch (event.button.button) {
-                case SDL_BUTTON_RIGHT:
-                    SDL_SetRelativeMouseMode(SDL_FALSE);
-                    SDL_WarpMouseInWindow(window_, mouse_.x, mouse_.y);
+                case SDL_MOUSEBUTTONDOWN:
+                    switch (event.button.button) {
+                    case SDL_BUTTON_LEFT:
+                        if (!ImGui::GetIO().WantCaptureMouse)
+                            pickInstance(event.button.x, event.button.y);
+                        break;
+                    case SDL_BUTTON_MIDDLE:
+                        camera_.reset();
+                        break;
+                    case SDL_BUTTON_RIGHT:
+                        SDL_GetMouseState(&mouse_.x, &mouse_.y);
+                        SDL_SetRelativeMouseMode(SDL_TRUE);
+                        SDL_WarpMouseInWindow(window_, center.x, center.y);
+                        break;
+                    }
                     break;
-                }
-                break;
-
-            case SDL_MOUSEWHEEL:
-                camera_.zoom(event.wheel.y);
-                break;
 
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.sym) {
-                case SDLK_ESCAPE:
-                    quit = true;
-                    break;
-                case SDLK_w:
-                    wasd[0] = 1;
-                    break;
-                case SDLK_a:
-                    wasd[1] = 1;
-                    break;
-                case SDLK_s:
-                    wasd[2] = 1;
-                    break;
-                case SDLK_d:
-                    wasd[3] = 1;
-                    break;
-                case SDLK_SPACE:
-                    spacelctrl[0] = 1;
-                    break;
-                case SDLK_LCTRL:
-                    spacelctrl[1] = 1;
-                    break;
-                case SDLK_LSHIFT:
-                    slow = 0.5f;
+                case SDL_MOUSEBUTTONUP:
+                    switch (event.button.button) {
+                    case SDL_BUTTON_RIGHT:
+                        SDL_SetRelativeMouseMode(SDL_FALSE);
+                        SDL_WarpMouseInWindow(window_, mouse_.x, mouse_.y);
+                        break;
+                    }
                     break;
-                }
-                break;
 
-            case SDL_KEYUP:
-                switch (event.key.keysym.sym) {
-                case SDLK_w:
-                    wasd[0] = 0;
-                    break;
-                case SDLK_a:
-                    wasd[1] = 0;
-                    break;
-                case SDLK_s:
-                    wasd[2] = 0;
+                case SDL_MOUSEWHEEL:
+                    camera_.zoom(event.wheel.y);
                     break;
-                case SDLK_d:
-                    wasd[3] = 0;
-                    break;
-                case SDLK_SPACE:
-                    spacelctrl[0] = 0;
-                    break;
-                case SDLK_LCTRL:
-                    spacelctrl[1] = 0;
+
+                case SDL_KEYDOWN:
+                    switch (event.key.keysym.sym) {
+                    case SDLK_ESCAPE:
+                        quit = true;
+                        break;
+                    case SDLK_F10:
+                        Profiler::writeChromeTrace(tracePath_);
+                        break;
+                    case SDLK_w:
+                        wasd[0] = 1;
+                        break;
+                    case SDLK_a:
+                        wasd[1] = 1;
+                        break;
+                    case SDLK_s:
+                        wasd[2] = 1;
+                        break;
+                    case SDLK_d:
+                        wasd[3] = 1;
+                        break;
+                    case SDLK_SPACE:
+                        spacelctrl[0] = 1;
+                        break;
+                    case SDLK_LCTRL:
+                        spacelctrl[1] = 1;
+                        break;
+                    case SDLK_LSHIFT:
+                        slow = 0.5f;
+                        break;
+                    }
                     break;
-                case SDLK_LSHIFT:
-                    slow = 1.0f;
+
+                case SDL_KEYUP:
+                    switch (event.key.keysym.sym) {
+                    case SDLK_w:
+                        wasd[0] = 0;
+                        break;
+                    case SDLK_a:
+                        wasd[1] = 0;
+                        break;
+                    case SDLK_s:
+                        wasd[2] = 0;
+                        break;
+                    case SDLK_d:
+                        wasd[3] = 0;
+                        break;
+                    case SDLK_SPACE:
+                        spacelctrl[0] = 0;
+                        break;
+                    case SDLK_LCTRL:
+                        spacelctrl[1] = 0;
+                        break;
+                    case SDLK_LSHIFT:
+                        slow = 1.0f;
+                        break;
+                    }
                     break;
                 }
-                break;
             }
         }
 
         if (SDL_GetWindowFlags(window_) & SDL_WINDOW_MINIMIZED)
             continue;
 
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplSDL2_NewFrame(window_);
-        ImGui::NewFrame();
-        // ImGui::ShowDemoWindow();
-        ImGui::Render();
-
-        drawFrame();
-
-        Uint64 end = SDL_GetPerformanceCounter();
-        float elapsedMs = (float)(end - start) / (float)SDL_GetPerformanceFrequency();
+        if (isAntiAliasingChanged_)
+            applyAntiAliasing();
 
+        // the camera moves by the previous frame's time, the uniforms are ready before drawing
         if (SDL_GetRelativeMouseMode()) {
             SDL_GetMouseState(&mouse.x, &mouse.y);
             camera_.rotate(mouse.x - center.x, mouse.y - center.y);
@@ -255,31 +362,287 @@ void Engine::run()
         keyStates = SDL_GetKeyboardState(nullptr);
 
         if (keyStates[SDL_SCANCODE_W] || keyStates[SDL_SCANCODE_A] || keyStates[SDL_SCANCODE_S] || keyStates[SDL_SCANCODE_D] || keyStates[SDL_SCANCODE_SPACE] || keyStates[SDL_SCANCODE_LCTRL] || keyStates[SDL_SCANCODE_LSHIFT])
-            camera_.move(wasd, spacelctrl, speed * elapsedMs * slow);
+            camera_.move(wasd, spacelctrl, speed * elapsed * slow);
+        updateUniformBuffers(elapsed);
+
+        buildUi();
+        drawFrame();
+        frame++;
+
+        Uint64 end = SDL_GetPerformanceCounter();
+        elapsed = (float)(end - start) / (float)SDL_GetPerformanceFrequency();
+
+        // cpu time is the frame without the waits on the gpu and the swapchain
+        if (governor_ && governor_->update(std::max(elapsed * 1000.0 - frameWaitMs_, 0.0), gpuProfiler_->frameMs()))
+            applyQualityLevel(governor_->level());
+
+        frameStats_->record(elapsed * 1000.0);
+        if (frameStats_->isSummaryDue())
+            LOG_INFO(frameStats_->summaryLine().c_str(), "STATS");
+    }
+
+    device_->waitIdle();
+    pipelineCache_->save();
+    if (isTraceOnExit_)
+        Profiler::writeChromeTrace(tracePath_);
+}
+
+void Engine::runBenchmark()
+{
+    BenchmarkCreateInfo benchmarkInfo = benchmarkInfo_;
+    benchmarkInfo.frameCount = frameCount_;
+    benchmarkInfo.gpuLatency = sConcurrentFrames_;
+    if (!model_->bvh.empty()) {
+        benchmarkInfo.sceneMin = model_->bvh.root().min;
+        benchmarkInfo.sceneMax = model_->bvh.root().max;
+    }
+    benchmark_ = createBenchmarkUnique(benchmarkInfo);
+
+    float elapsed = 0.0f;
+    while (!benchmark_->finished()) {
+        PL_PROFILE_ZONE("Engine::frame");
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        // only quitting is handled, input would change what is measured
+        if (!isHeadless_) {
+            bool quit = false;
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {
+                if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
+                    quit = true;
+            }
+            if (quit)
+                break;
+            buildUi();
+        }
+
+        // the pose of this frame, drawn by it
+        glm::vec3 eye, center;
+        benchmark_->cameraPose(eye, center);
+        camera_.lookAt(eye, center, { 0.0f, 1.0f, 0.0f });
+        updateUniformBuffers(elapsed);
+
+        drawFrame();
+
+        Uint64 end = SDL_GetPerformanceCounter();
+        elapsed = (float)(end - start) / (float)SDL_GetPerformanceFrequency();
+
+        FrameSample sample {
+            .cpuMs = (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency(),
+            .gpuMs = gpuProfiler_->frameMs(),
+            .draws = drawStats_.draws + drawStats_.indirectDraws,
+            .triangles = drawStats_.triangles,
+            .binds = drawStats_.pipelineBinds + drawStats_.descriptorBinds,
+            .gpuZones = gpuProfiler_->zones()
+        };
+        benchmark_->record(sample);
+    }
+
+    device_->waitIdle();
+    pipelineCache_->save();
+    benchmark_->writeReport();
+    if (isTraceOnExit_)
+        Profiler::writeChromeTrace(tracePath_);
+}
+
+int Engine::exitStatus() const
+{
+    return benchmark_ ? benchmark_->exitStatus() : 0;
+}
+
+void Engine::buildUi()
+{
+    PL_PROFILE_ZONE("Engine::buildUi");
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplSDL2_NewFrame(window_);
+    ImGui::NewFrame();
+    // ImGui::ShowDemoWindow();
+    ImGui::Begin("Renderer");
+    ImGui::Text("draws %u, indirect %u", drawStats_.draws, drawStats_.indirectDraws);
+    ImGui::Text("binds %u pipeline, %u descriptor, %u push", drawStats_.pipelineBinds, drawStats_.descriptorBinds, drawStats_.pushConstants);
+    ImGui::Text("saved %u pipeline, %u descriptor, %u push", drawStats_.skippedPipelineBinds, drawStats_.skippedDescriptorBinds, drawStats_.skippedPushConstants);
+    ImGui::Text("color %u visible, %u culled", colorCullStats_.visible, colorCullStats_.culled);
+    ImGui::Text("shadow %u visible, %u culled", shadowCullStats_.visible, shadowCullStats_.culled);
+    if (pickedInstance_ >= 0)
+        ImGui::Text("picked %s", model_->instances[pickedInstance_].node->name.c_str());
+    if (isGpuDriven_)
+        ImGui::Checkbox("occlusion culling", &isOcclusionCulling_);
+    ImGui::Checkbox("depth prepass", &isDepthPrepass_);
+    // rebuilt before the next frame
+    const char* antiAliasingModes[] = { "off", "msaa 2x", "msaa 4x", "msaa 8x", "post" };
+    int antiAliasing = static_cast<int>(antiAliasing_);
+    if (ImGui::Combo("anti-aliasing", &antiAliasing, antiAliasingModes, IM_ARRAYSIZE(antiAliasingModes))) {
+        antiAliasing_ = static_cast<AntiAliasing>(antiAliasing);
+        isAntiAliasingChanged_ = true;
+    }
+    if (msaaSamples_ != vk::SampleCountFlagBits::e1)
+        ImGui::Text("%u samples", static_cast<uint32_t>(msaaSamples_));
+    // the scene targets are rebuilt once the slider is let go, the governor owns the scale when it runs
+    if (isRenderScaled_ && !governor_) {
+        ImGui::SliderFloat("render scale", &renderScale_, 0.25f, 1.0f, "%.2f");
+        if (ImGui::IsItemDeactivatedAfterEdit())
+            createSceneTargets();
+    }
+    if (isRenderScaled_)
+        ImGui::Text("render %ux%u of %ux%u", renderExtent_.width, renderExtent_.height, extent_.width, extent_.height);
+    if (ubo_.lightParams.x > 0)
+        ImGui::Text("%u lights in %ux%ux%u clusters", ubo_.lightParams.x, sClusterGridX_, sClusterGridY_, sClusterGridZ_);
+    if (governor_) {
+        ImGui::Text("quality level %u of %u, %.2f of %.2f ms", governor_->levelIndex() + 1, governor_->levelCount(), governor_->smoothedMs(), governor_->targetMs());
+        ImGui::Text("shadow map %u, lod bias %.1f", shadowPass_.width, lodBias_);
+    }
+    ImGui::End();
+
+    FrameStatsSummary frameSummary = frameStats_->summary();
+    const auto& frameTimes = frameStats_->frameTimes();
+    const auto& histogram = frameStats_->histogram();
+    ImGui::Begin("Frame");
+    ImGui::Text("min %.2f, mean %.2f, max %.2f ms", frameSummary.min, frameSummary.mean, frameSummary.max);
+    ImGui::Text("p50 %.2f, p95 %.2f, p99 %.2f ms", frameSummary.p50, frameSummary.p95, frameSummary.p99);
+    ImGui::Text("%u stutters in %u frames, %llu total", frameSummary.stutters, frameSummary.frames, (unsigned long long)frameStats_->totalStutters());
+    if (frameStats_->totalStutters() > 0)
+        ImGui::Text("last stutter %.2f ms", frameStats_->lastStutterMs());
+    ImGui::PlotLines("ms", frameTimes.data(), static_cast<int>(frameTimes.size()), static_cast<int>(frameStats_->offset()), nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+    ImGui::PlotHistogram("1 ms buckets", histogram.data(), static_cast<int>(histogram.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+    ImGui::End();
+
+    // gpu times lag the cpu by the frames in flight
+    if (gpuProfiler_->supported()) {
+        ImGui::Begin("GPU");
+        const auto& history = gpuProfiler_->history();
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f ms", gpuProfiler_->frameMs());
+        ImGui::PlotLines("frame", history.data(), static_cast<int>(history.size()), static_cast<int>(gpuProfiler_->historyOffset()), overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+        if (ImGui::BeginTable("passes", 3)) {
+            ImGui::TableSetupColumn("pass");
+            ImGui::TableSetupColumn("ms");
+            ImGui::TableSetupColumn("avg ms");
+            ImGui::TableHeadersRow();
+            for (const auto& _zone : gpuProfiler_->zones()) {
+                auto average = std::find_if(gpuProfiler_->zoneAverages().begin(), gpuProfiler_->zoneAverages().end(), [&](const GpuZoneTime& _average) {
+                    return strcmp(_average.name, _zone.name) == 0;
+                });
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(_zone.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", _zone.ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", average != gpuProfiler_->zoneAverages().end() ? average->ms : _zone.ms);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+    ImGui::Render();
+}
+
+void Engine::runHeadless()
+{
+    // fixed time step, every run renders the same frames
+    const float elapsed = 1.0f / 60.0f;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    for (uint32_t i = 0; i < frameCount_; i++) {
+        PL_PROFILE_ZONE("Engine::frame");
+        updateUniformBuffers(elapsed);
+        drawFrame();
+    }
 
-        updateUniformBuffers(elapsedMs);
+    device_->waitIdle();
+    pipelineCache_->save();
+    if (isTraceOnExit_)
+        Profiler::writeChromeTrace(tracePath_);
+
+    float seconds = (float)(SDL_GetPerformanceCounter() - start) / (float)SDL_GetPerformanceFrequency();
+    printf("%u frames in %.3f s, %.1f fps\n", frameCount_, seconds, (float)frameCount_ / seconds);
+}
 
-        printf("\33[2K%d fps\r", (int)(1.0 / elapsedMs));
+void Engine::applyQualityLevel(const QualityLevel& level)
+{
+    // a new scale only rebuilds what the render extent sizes, the swapchain is kept
+    if (level.renderScale != renderScale_) {
+        renderScale_ = level.renderScale;
+        createSceneTargets();
     }
+    // a new resolution makes the shadow cache stale, the map is redrawn next frame
+    shadowPass_.width = level.shadowResolution;
+    shadowPass_.height = level.shadowResolution;
+    shadowFilter_ = level.shadowFilter;
+    lodBias_ = level.lodBias;
+
+    char line[128];
+    snprintf(line, sizeof(line), "quality level %u, scale %.2f, shadow map %u, filter %u, lod bias %.1f",
+        governor_->levelIndex(), level.renderScale, level.shadowResolution, static_cast<uint32_t>(level.shadowFilter), level.lodBias);
+    LOG_INFO(line, "QUALITY");
+}
+
+vk::SampleCountFlagBits Engine::sampleCount(AntiAliasing antiAliasing) const
+{
+    uint32_t samples = antiAliasing == AntiAliasing::Msaa2 ? 2 : antiAliasing == AntiAliasing::Msaa4 ? 4 : antiAliasing == AntiAliasing::Msaa8 ? 8 : 1;
+    // the largest count both color and depth attachments support, 1 always is
+    const auto& limits = physicalDevice_.getProperties().limits;
+    vk::SampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+    while (samples > 1 && !(supported & static_cast<vk::SampleCountFlagBits>(samples)))
+        samples /= 2;
+    return static_cast<vk::SampleCountFlagBits>(samples);
+}
 
+void Engine::applyAntiAliasing()
+{
+    PL_PROFILE_ZONE("Engine::applyAntiAliasing");
+    // a rare, user driven change, waiting once is simpler than retiring passes and pipelines
     device_->waitIdle();
+    isAntiAliasingChanged_ = false;
+    msaaSamples_ = sampleCount(antiAliasing_);
+    isSceneOffscreen_ = isRenderScaled_ || antiAliasing_ == AntiAliasing::Post;
+    if (isSceneOffscreen_ && !upscale_.pipeline)
+        createUpscaler();
+
+    if (!isHeadless_)
+        ImGui_ImplVulkan_Shutdown();
+    createRenderPass();
+    createPipelines();
+
+    // attachments, framebuffers and the depth pyramid follow the new sample count, the swapchain
+    // usage and the scene image follow isSceneOffscreen_
+    retireAttachments();
+    if (upscale_.sceneImage) {
+        auto& retired = retireResources();
+        retired.framebuffers.push_back(std::move(upscale_.sceneFramebuffer));
+        retired.views.push_back(std::move(upscale_.sceneView));
+        retired.images.push_back(upscale_.sceneImage);
+        upscale_.sceneImage = nullptr;
+    }
+    recreateSwapchain();
+    if (!isHeadless_)
+        initImGuiRenderer();
+
+    char line[64];
+    snprintf(line, sizeof(line), "anti-aliasing %u, %u samples", static_cast<uint32_t>(antiAliasing_), static_cast<uint32_t>(msaaSamples_));
+    LOG_INFO(line, "GFX");
 }
 
 void Engine::createInstance()
 {
-    // window
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_Vulkan_LoadLibrary(nullptr);
-    window_ = SDL_CreateWindow("viewer", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        sWidth_, sHeight_, SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN);
-    SDL_SetWindowMinimumSize(window_, 800, 600);
+    // window, headless rendering needs no video subsystem
+    if (!isHeadless_) {
+        SDL_Init(SDL_INIT_VIDEO);
+        SDL_Vulkan_LoadLibrary(nullptr);
+        window_ = SDL_CreateWindow("viewer", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            sWidth_, sHeight_, SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN);
+        SDL_SetWindowMinimumSize(window_, 800, 600);
+    }
     extent_ = vk::Extent3D { sWidth_, sHeight_, 1 };
 
     // sdl2
-    unsigned int extensionCount;
-    SDL_Vulkan_GetInstanceExtensions(window_, &extensionCount, nullptr);
-    std::vector<const char*> instanceExtensions(extensionCount);
-    SDL_Vulkan_GetInstanceExtensions(window_, &extensionCount, instanceExtensions.data());
+    std::vector<const char*> instanceExtensions;
+    if (!isHeadless_) {
+        unsigned int extensionCount;
+        SDL_Vulkan_GetInstanceExtensions(window_, &extensionCount, nullptr);
+        instanceExtensions.resize(extensionCount);
+        SDL_Vulkan_GetInstanceExtensions(window_, &extensionCount, instanceExtensions.data());
+    }
 
     // molten vk
     vk::InstanceCreateFlagBits flags {};
@@ -329,6 +692,8 @@ void Engine::createInstance()
     VULKAN_HPP_DEFAULT_DISPATCHER.init(*instance_);
 
     // surface
+    if (isHeadless_)
+        return;
     VkSurfaceKHR surface;
     SDL_Vulkan_CreateSurface(window_, *instance_, &surface);
     vk::ObjectDestroy<vk::Instance, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE> deleter(*instance_);
@@ -338,7 +703,8 @@ void Engine::createInstance()
 void Engine::createDevice()
 {
     // physical device
-    for (auto& _physicalDevice : instance_->enumeratePhysicalDevices()) {
+    std::vector<vk::PhysicalDevice> physicalDevices = instance_->enumeratePhysicalDevices();
+    for (auto& _physicalDevice : physicalDevices) {
         vk::PhysicalDeviceProperties deviceProperties = _physicalDevice.getProperties();
         vk::PhysicalDeviceFeatures deviceFeatures = _physicalDevice.getFeatures();
         if (deviceProperties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu) {
@@ -352,6 +718,14 @@ void Engine::createDevice()
             break;
         }
     }
+    // headless rendering presents nothing, any device will do
+    if (!physicalDevice_ && isHeadless_ && !physicalDevices.empty())
+        physicalDevice_ = physicalDevices.front();
+    if (!physicalDevice_) {
+        LOG_ERROR("Failed to find a Vulkan device.", "GFX");
+        exit(1);
+    }
+    LOG_INFO(physicalDevice_.getProperties().deviceName.data(), "GFX");
 
     // queue families
     std::vector<vk::QueueFamilyProperties> queueFamilies = physicalDevice_.getQueueFamilyProperties();
@@ -370,13 +744,49 @@ void Engine::createDevice()
     // device
     vk::PhysicalDeviceFeatures deviceFeatures { .samplerAnisotropy = VK_TRUE };
     std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 #ifdef __APPLE__
         VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME
 #endif
     };
+    if (!isHeadless_)
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    // gpu driven rendering
+    if (isGpuDriven_) {
+        auto extensions = physicalDevice_.enumerateDeviceExtensionProperties();
+        bool hasDrawIndirectCount = std::any_of(extensions.begin(), extensions.end(), [](const vk::ExtensionProperties& extension) {
+            return strcmp(extension.extensionName.data(), VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0;
+        });
+        vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice_.getFeatures();
+
+        if (hasDrawIndirectCount && supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance) {
+            deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            deviceFeatures.multiDrawIndirect = VK_TRUE;
+            deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        } else {
+            LOG_WARN("Indirect count draws not supported, falling back to CPU draws.", "GFX");
+            isGpuDriven_ = false;
+        }
+    }
+    if (isOcclusionCulling_ && !isGpuDriven_) {
+        LOG_WARN("Occlusion culling requires GPU driven rendering, disabling.", "GFX");
+        isOcclusionCulling_ = false;
+    }
+
+    // multiview, renders every shadow cascade in one pass
+    vk::PhysicalDeviceMultiviewFeatures multiviewFeatures {};
+    if (physicalDevice_.getProperties().apiVersion >= VK_API_VERSION_1_1) {
+        auto supportedFeatures = physicalDevice_.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMultiviewFeatures>();
+        isShadowMultiview_ = supportedFeatures.get<vk::PhysicalDeviceMultiviewFeatures>().multiview;
+    }
+    if (isShadowMultiview_) {
+        multiviewFeatures.multiview = VK_TRUE;
+    } else {
+        LOG_INFO("Multiview not supported, drawing shadow cascades separately.", "GFX");
+    }
 
     vk::DeviceCreateInfo deviceInfo {
+        .pNext = isShadowMultiview_ ? &multiviewFeatures : nullptr,
         .queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size()),
         .pQueueCreateInfos = queueInfos.data(),
         .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
@@ -385,6 +795,7 @@ void Engine::createDevice()
     };
 
     device_ = physicalDevice_.createDeviceUnique(deviceInfo);
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(*device_);
 
     // graphics queue
     graphicsQueue_ = device_->getQueue(queueFamilyIndices_.graphics, 0);
@@ -422,6 +833,17 @@ void Engine::createMemoryHelper()
     memoryHelper_ = createMemoryHelperUnique(memoryInfo);
 }
 
+void Engine::createPipelineCache()
+{
+    pl::PipelineCacheCreateInfo cacheInfo {
+        .physicalDevice = physicalDevice_,
+        .device = *device_,
+        .directory = "."
+    };
+
+    pipelineCache_ = createPipelineCacheUnique(cacheInfo);
+}
+
 void Engine::createShadowPassResources()
 {
     shadowPass_.width = sShadowResolution_;
@@ -429,20 +851,30 @@ void Engine::createShadowPassResources()
 
     vk::Extent3D extent { .width = sShadowResolution_, .height = sShadowResolution_, .depth = 1 };
 
-    shadowPass_.depthImage = memoryHelper_->createImage(extent, sDepthAttachmentFormat_, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled, 1, vk::SampleCountFlagBits::e1);
-    shadowPass_.depthView = memoryHelper_->createImageViewUnique(shadowPass_.depthImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 1);
+    shadowPass_.depthImage = memoryHelper_->createImage(extent, sDepthAttachmentFormat_, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, 1, vk::SampleCountFlagBits::e1, ShadowCascades::sCount);
+    shadowPass_.depthView = memoryHelper_->createArrayImageViewUnique(shadowPass_.depthImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 0, ShadowCascades::sCount);
+    if (isShadowMultiview_) {
+        shadowPass_.layerViews.push_back(memoryHelper_->createArrayImageViewUnique(shadowPass_.depthImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 0, ShadowCascades::sCount));
+    } else {
+        for (uint32_t i = 0; i < ShadowCascades::sCount; i++) {
+            shadowPass_.layerViews.push_back(memoryHelper_->createArrayImageViewUnique(shadowPass_.depthImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, i, 1));
+        }
+    }
 
+    // hardware compare, linear filtering blends the four nearest results
     vk::SamplerCreateInfo samplerInfo {
         .magFilter = vk::Filter::eLinear,
         .minFilter = vk::Filter::eLinear,
-        .mipmapMode = vk::SamplerMipmapMode::eLinear,
-        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
-        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToBorder,
+        .addressModeV = vk::SamplerAddressMode::eClampToBorder,
         .addressModeW = vk::SamplerAddressMode::eClampToEdge,
         .mipLodBias = 0.0f,
         .maxAnisotropy = 1.0f,
+        .compareEnable = VK_TRUE,
+        .compareOp = vk::CompareOp::eLessOrEqual,
         .minLod = 0.0f,
-        .maxLod = 1.0f,
+        .maxLod = 0.0f,
         .borderColor = vk::BorderColor::eFloatOpaqueWhite
     };
 
@@ -498,18 +930,135 @@ void Engine::createShadowPassResources()
         .pDependencies = dependencies.data()
     };
 
-    shadowPass_.renderPass = device_->createRenderPassUnique(renderPassInfo);
+    shadowPass_.renderPass = createShadowRenderPass(renderPassInfo);
+    shadowPass_.frameBuffers = createShadowFramebuffers(*shadowPass_.renderPass, shadowPass_.layerViews);
+
+    // the map stays bound in the sampled layout even when no pass ever draws it
+    vk::ImageMemoryBarrier readBarrier {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = shadowPass_.depthImage->image,
+        .subresourceRange = {
+            .aspectMask = vk::ImageAspectFlagBits::eDepth,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = ShadowCascades::sCount }
+    };
+    auto cmd = beginOneTimeCommandBuffer();
+    cmd->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, readBarrier);
+    endOneTimeCommandBuffer(*cmd);
+}
+
+void Engine::createShadowCacheResources()
+{
+    vk::Extent3D extent { .width = sShadowResolution_, .height = sShadowResolution_, .depth = 1 };
+
+    shadowPass_.staticImage = memoryHelper_->createImage(extent, sDepthAttachmentFormat_, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc, 1, vk::SampleCountFlagBits::e1, ShadowCascades::sCount);
+    if (isShadowMultiview_) {
+        shadowPass_.staticViews.push_back(memoryHelper_->createArrayImageViewUnique(shadowPass_.staticImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 0, ShadowCascades::sCount));
+    } else {
+        for (uint32_t i = 0; i < ShadowCascades::sCount; i++) {
+            shadowPass_.staticViews.push_back(memoryHelper_->createArrayImageViewUnique(shadowPass_.staticImage->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, i, 1));
+        }
+    }
+
+    // static layer, left in the transfer layout between redraws
+    vk::AttachmentDescription depthAttachment {
+        .format = sDepthAttachmentFormat_,
+        .samples = vk::SampleCountFlagBits::e1,
+        .loadOp = vk::AttachmentLoadOp::eClear,
+        .storeOp = vk::AttachmentStoreOp::eStore,
+        .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+        .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+        .initialLayout = vk::ImageLayout::eUndefined,
+        .finalLayout = vk::ImageLayout::eTransferSrcOptimal
+    };
+
+    vk::AttachmentReference depthAttachmentRef {
+        .attachment = 0,
+        .layout = vk::ImageLayout::eDepthStencilAttachmentOptimal
+    };
+
+    vk::SubpassDescription subpass {
+        .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+        .colorAttachmentCount = 0,
+        .pDepthStencilAttachment = &depthAttachmentRef
+    };
+
+    std::array<vk::SubpassDependency, 2> dependencies {
+        vk::SubpassDependency {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = vk::PipelineStageFlagBits::eTransfer,
+            .dstStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests,
+            .dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite },
+        vk::SubpassDependency {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = vk::PipelineStageFlagBits::eLateFragmentTests,
+            .dstStageMask = vk::PipelineStageFlagBits::eTransfer,
+            .srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eTransferRead }
+    };
 
-    vk::FramebufferCreateInfo framebufferInfo {
-        .renderPass = *shadowPass_.renderPass,
+    vk::RenderPassCreateInfo renderPassInfo {
         .attachmentCount = 1,
-        .pAttachments = &shadowPass_.depthView.get(),
-        .width = shadowPass_.width,
-        .height = shadowPass_.height,
-        .layers = 1
+        .pAttachments = &depthAttachment,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = static_cast<uint32_t>(dependencies.size()),
+        .pDependencies = dependencies.data()
+    };
+
+    shadowPass_.staticRenderPass = createShadowRenderPass(renderPassInfo);
+    shadowPass_.staticFrameBuffers = createShadowFramebuffers(*shadowPass_.staticRenderPass, shadowPass_.staticViews);
+
+    // dynamic casters, drawn over the copied static layer
+    depthAttachment.loadOp = vk::AttachmentLoadOp::eLoad;
+    depthAttachment.initialLayout = vk::ImageLayout::eTransferDstOptimal;
+    depthAttachment.finalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+    dependencies[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    dependencies[0].dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    dependencies[1].dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
+    dependencies[1].dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    shadowPass_.overlayRenderPass = createShadowRenderPass(renderPassInfo);
+}
+
+vk::UniqueRenderPass Engine::createShadowRenderPass(vk::RenderPassCreateInfo renderPassInfo)
+{
+    // every view writes its own layer of the same attachment
+    uint32_t viewMask = (1u << ShadowCascades::sCount) - 1;
+    vk::RenderPassMultiviewCreateInfo multiviewInfo {
+        .subpassCount = 1,
+        .pViewMasks = &viewMask
     };
 
-    shadowPass_.frameBuffer = device_->createFramebufferUnique(framebufferInfo);
+    if (isShadowMultiview_)
+        renderPassInfo.pNext = &multiviewInfo;
+
+    return device_->createRenderPassUnique(renderPassInfo);
+}
+
+std::vector<vk::UniqueFramebuffer> Engine::createShadowFramebuffers(vk::RenderPass renderPass, const std::vector<vk::UniqueImageView>& layerViews)
+{
+    std::vector<vk::UniqueFramebuffer> frameBuffers;
+    for (const auto& _layerView : layerViews) {
+        // multiview framebuffers must have a single layer, the view mask picks the array layers
+        vk::FramebufferCreateInfo framebufferInfo {
+            .renderPass = renderPass,
+            .attachmentCount = 1,
+            .pAttachments = &_layerView.get(),
+            .width = sShadowResolution_,
+            .height = sShadowResolution_,
+            .layers = 1
+        };
+        frameBuffers.push_back(device_->createFramebufferUnique(framebufferInfo));
+    }
+    return frameBuffers;
 }
 
 void Engine::createDescriptorLayouts()
@@ -518,7 +1067,7 @@ void Engine::createDescriptorLayouts()
         .binding = 0,
         .descriptorType = vk::DescriptorType::eUniformBuffer,
         .descriptorCount = 1,
-        .stageFlags = vk::ShaderStageFlagBits::eVertex
+        .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment
     };
     vk::DescriptorSetLayoutBinding shadowMapSamplerBinding {
         .binding = 1,
@@ -526,7 +1075,26 @@ void Engine::createDescriptorLayouts()
         .descriptorCount = 1,
         .stageFlags = vk::ShaderStageFlagBits::eFragment
     };
-    std::array<vk::DescriptorSetLayoutBinding, 2> uboLayoutBindings { uboLayoutBinding, shadowMapSamplerBinding };
+    vk::DescriptorSetLayoutBinding instanceBufferBinding {
+        .binding = 2,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eVertex
+    };
+    // point and spot lights, their indices by cluster
+    vk::DescriptorSetLayoutBinding lightBufferBinding {
+        .binding = 3,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eFragment
+    };
+    vk::DescriptorSetLayoutBinding clusterBufferBinding {
+        .binding = 4,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eFragment
+    };
+    std::array<vk::DescriptorSetLayoutBinding, 5> uboLayoutBindings { uboLayoutBinding, shadowMapSamplerBinding, instanceBufferBinding, lightBufferBinding, clusterBufferBinding };
     vk::DescriptorSetLayoutCreateInfo uboDescriptorLayoutInfo {
         .bindingCount = static_cast<uint32_t>(uboLayoutBindings.size()),
         .pBindings = uboLayoutBindings.data()
@@ -551,13 +1119,50 @@ void Engine::createDescriptorLayouts()
         .pBindings = materialLayoutBindings.data()
     };
     descriptorLayouts_.material = device_->createDescriptorSetLayoutUnique(materialDescriptorLayoutInfo);
+
+    // instances, draw commands, draw counts, visibility, frame ubo, depth pyramid
+    std::array<vk::DescriptorSetLayoutBinding, 6> cullLayoutBindings;
+    for (uint32_t i = 0; i < cullLayoutBindings.size(); i++) {
+        cullLayoutBindings[i] = {
+            .binding = i,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute
+        };
+    }
+    cullLayoutBindings[4].descriptorType = vk::DescriptorType::eUniformBuffer;
+    cullLayoutBindings[5].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    vk::DescriptorSetLayoutCreateInfo cullDescriptorLayoutInfo {
+        .bindingCount = static_cast<uint32_t>(cullLayoutBindings.size()),
+        .pBindings = cullLayoutBindings.data()
+    };
+    gpuDriven_.descriptorLayout = device_->createDescriptorSetLayoutUnique(cullDescriptorLayoutInfo);
+
+    // depth pyramid source level, target level
+    std::array<vk::DescriptorSetLayoutBinding, 2> reduceLayoutBindings {
+        vk::DescriptorSetLayoutBinding {
+            .binding = 0,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute },
+        vk::DescriptorSetLayoutBinding {
+            .binding = 1,
+            .descriptorType = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute }
+    };
+    vk::DescriptorSetLayoutCreateInfo reduceDescriptorLayoutInfo {
+        .bindingCount = static_cast<uint32_t>(reduceLayoutBindings.size()),
+        .pBindings = reduceLayoutBindings.data()
+    };
+    occlusion_.descriptorLayout = device_->createDescriptorSetLayoutUnique(reduceDescriptorLayoutInfo);
 }
 
 void Engine::createRenderPass()
 {
     vk::AttachmentDescription colorAttachment {
         .format = sSwapchainFormat_,
-        .samples = sMsaaSamples_,
+        .samples = msaaSamples_,
         .loadOp = vk::AttachmentLoadOp::eClear,
         .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
         .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
@@ -575,7 +1180,8 @@ void Engine::createRenderPass()
         .loadOp = vk::AttachmentLoadOp::eDontCare,
         .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
         .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
-        .finalLayout = vk::ImageLayout::ePresentSrcKHR
+        // headless frames are left ready to be copied out, scaled frames ready to be upscaled
+        .finalLayout = isSceneOffscreen_ ? vk::ImageLayout::eShaderReadOnlyOptimal : isHeadless_ ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR
     };
 
     vk::AttachmentReference colorResolveRef {
@@ -585,7 +1191,7 @@ void Engine::createRenderPass()
 
     vk::AttachmentDescription depthAttachment {
         .format = sDepthAttachmentFormat_,
-        .samples = sMsaaSamples_,
+        .samples = msaaSamples_,
         .loadOp = vk::AttachmentLoadOp::eClear,
         .storeOp = vk::AttachmentStoreOp::eDontCare,
         .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
@@ -606,6 +1212,15 @@ void Engine::createRenderPass()
         .pDepthStencilAttachment = &depthAttachmentRef
     };
 
+    // single sampled, the scene is drawn straight into the resolve target
+    bool isMultisampled = msaaSamples_ != vk::SampleCountFlagBits::e1;
+    if (!isMultisampled) {
+        colorAttachment = colorResolve;
+        colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+        colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+        subpass.pResolveAttachments = nullptr;
+    }
+
     vk::SubpassDependency dependency {
         .srcSubpass = VK_SUBPASS_EXTERNAL,
         .dstSubpass = 0,
@@ -614,24 +1229,66 @@ void Engine::createRenderPass()
         .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite
     };
 
-    std::array<vk::AttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorResolve };
+    std::vector<vk::SubpassDependency> dependencies { dependency };
+
+    // gpu driven rendering keeps the depth buffer to build the depth pyramid
+    if (isGpuDriven_) {
+        depthAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+        depthAttachment.finalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        dependencies[0].srcStageMask |= vk::PipelineStageFlagBits::eComputeShader;
+        dependencies.push_back({
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = vk::PipelineStageFlagBits::eLateFragmentTests,
+            .dstStageMask = vk::PipelineStageFlagBits::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead });
+    }
+
+    // the upscaler reads the resolved scene, and last frame's read finishes before it is written again
+    if (isSceneOffscreen_) {
+        dependencies[0].srcStageMask |= vk::PipelineStageFlagBits::eComputeShader;
+        dependencies.push_back({
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .dstStageMask = vk::PipelineStageFlagBits::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead });
+    }
+
+    std::vector<vk::AttachmentDescription> attachments = { colorAttachment, depthAttachment };
+    if (isMultisampled)
+        attachments.push_back(colorResolve);
 
     vk::RenderPassCreateInfo renderPassInfo {
         .attachmentCount = static_cast<uint32_t>(attachments.size()),
         .pAttachments = attachments.data(),
         .subpassCount = 1,
         .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency
+        .dependencyCount = static_cast<uint32_t>(dependencies.size()),
+        .pDependencies = dependencies.data()
     };
 
     renderPass_ = device_->createRenderPassUnique(renderPassInfo);
+
+    // second occlusion phase, draws on top of the first phase color and depth
+    if (isGpuDriven_) {
+        attachments[0].loadOp = vk::AttachmentLoadOp::eLoad;
+        attachments[0].initialLayout = attachments[0].finalLayout;
+        attachments[1].loadOp = vk::AttachmentLoadOp::eLoad;
+        attachments[1].initialLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        dependencies[0].srcStageMask |= vk::PipelineStageFlagBits::eLateFragmentTests;
+        dependencies[0].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        dependencies[0].dstAccessMask |= vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentRead;
+        occlusion_.loadRenderPass = device_->createRenderPassUnique(renderPassInfo);
+    }
 }
 
 void Engine::createPipelines()
 {
     // shaders
-    std::vector<char> shadowShaderBytes = readSpirVFile("shaders/shadow.spv");
+    std::vector<char> shadowShaderBytes = readSpirVFile(isShadowMultiview_ ? "shaders/shadow_multiview.spv" : "shaders/shadow.spv");
     std::vector<char> vertexShaderBytes = readSpirVFile("shaders/vertex.spv");
     std::vector<char> fragmentShaderBytes = readSpirVFile("shaders/fragment.spv");
 
@@ -647,7 +1304,7 @@ void Engine::createPipelines()
     vk::PushConstantRange pushConstantRange {
         .stageFlags = vk::ShaderStageFlagBits::eVertex,
         .offset = 0,
-        .size = sizeof(pushConstants_)
+        .size = sizeof(PushConstants)
     };
 
     // shadow pipeline layout
@@ -665,9 +1322,7 @@ void Engine::createPipelines()
 
     vk::PipelineLayoutCreateInfo texturePipelineLayoutInfo {
         .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
-        .pSetLayouts = setLayouts.data(),
-        .pushConstantRangeCount = 1,
-        .pPushConstantRanges = &pushConstantRange
+        .pSetLayouts = setLayouts.data()
     };
 
     texturePipeline_.layout = device_->createPipelineLayoutUnique(texturePipelineLayoutInfo);
@@ -760,7 +1415,7 @@ void Engine::createPipelines()
 
     // multisample state
     vk::PipelineMultisampleStateCreateInfo multisampleStateInfo = {
-        .rasterizationSamples = sMsaaSamples_,
+        .rasterizationSamples = msaaSamples_,
         .sampleShadingEnable = VK_FALSE
     };
 
@@ -812,7 +1467,114 @@ void Engine::createPipelines()
         .subpass = 0
     };
 
-    texturePipeline_.pipeline = device_->createGraphicsPipelineUnique(nullptr, pipelineInfo).value;
+    // color pass after the depth prepass, shades only the fragments that won the depth test
+    vk::PipelineDepthStencilStateCreateInfo equalDepthStencilStateInfo = depthStencilStateInfo;
+    equalDepthStencilStateInfo.depthWriteEnable = VK_FALSE;
+    equalDepthStencilStateInfo.depthCompareOp = vk::CompareOp::eEqual;
+
+    // depth prepass, no color writes
+    vk::PipelineColorBlendAttachmentState prepassBlendAttachment = colorBlendAttachment;
+    prepassBlendAttachment.colorWriteMask = {};
+    vk::PipelineColorBlendStateCreateInfo prepassBlendStateInfo = colorBlendStateInfo;
+    prepassBlendStateInfo.pAttachments = &prepassBlendAttachment;
+
+    std::vector<char> depthShaderBytes = readSpirVFile("shaders/depth.spv");
+    std::vector<char> depthAlphaShaderBytes = readSpirVFile("shaders/depth_alpha.spv");
+
+    vk::UniqueShaderModule depthShaderModule = device_->createShaderModuleUnique({ .codeSize = depthShaderBytes.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(depthShaderBytes.data()) });
+
+    vk::UniqueShaderModule depthAlphaShaderModule = device_->createShaderModuleUnique({ .codeSize = depthAlphaShaderBytes.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(depthAlphaShaderBytes.data()) });
+
+    // one pipeline per material variant, built on worker threads
+    struct PipelineBuild {
+        vk::GraphicsPipelineCreateInfo info;
+        std::array<vk::PipelineShaderStageCreateInfo, 2> stages;
+        FragmentConstants constants;
+        vk::SpecializationInfo specialization;
+        vk::UniquePipeline* pipeline;
+    };
+
+    std::array<vk::SpecializationMapEntry, 4> fragmentConstantEntries {
+        vk::SpecializationMapEntry { .constantID = 0, .offset = offsetof(FragmentConstants, shadowFilter), .size = sizeof(uint32_t) },
+        vk::SpecializationMapEntry { .constantID = 1, .offset = offsetof(FragmentConstants, normalMap), .size = sizeof(vk::Bool32) },
+        vk::SpecializationMapEntry { .constantID = 2, .offset = offsetof(FragmentConstants, alphaTest), .size = sizeof(vk::Bool32) },
+        vk::SpecializationMapEntry { .constantID = 3, .offset = offsetof(FragmentConstants, shadows), .size = sizeof(vk::Bool32) }
+    };
+
+    // the configured filter, or every filter up to it when the governor may step down to them
+    std::vector<ShadowFilter> filters { shadowFilter_ };
+    if (governor_ && isShadowPass_) {
+        filters.clear();
+        for (uint32_t i = 0; i <= static_cast<uint32_t>(shadowFilter_); i++)
+            filters.push_back(static_cast<ShadowFilter>(i));
+    }
+
+    std::vector<PipelineBuild> builds;
+    for (ShadowFilter _filter : filters) {
+        uint32_t filter = static_cast<uint32_t>(_filter);
+        for (uint32_t variant = 0; variant < sVariantCount_; variant++) {
+            PipelineBuild build {
+                .info = pipelineInfo,
+                .stages = { shaderStageInfos[0], shaderStageInfos[1] },
+                .constants = {
+                    .shadowFilter = filter,
+                    .normalMap = (variant & sNormalMapVariant_) ? VK_TRUE : VK_FALSE,
+                    .alphaTest = (variant & sAlphaTestVariant_) ? VK_TRUE : VK_FALSE,
+                    .shadows = isShadowPass_ ? VK_TRUE : VK_FALSE },
+                .specialization = {
+                    .mapEntryCount = static_cast<uint32_t>(fragmentConstantEntries.size()),
+                    .pMapEntries = fragmentConstantEntries.data(),
+                    .dataSize = sizeof(FragmentConstants) },
+                .pipeline = &texturePipeline_.pipelines[filter][variant]
+            };
+            builds.push_back(build);
+
+            build.info.pDepthStencilState = &equalDepthStencilStateInfo;
+            build.pipeline = &texturePipeline_.equalPipelines[filter][variant];
+            builds.push_back(build);
+        }
+    }
+    for (uint32_t alphaTest = 0; alphaTest < 2; alphaTest++) {
+        // opaque geometry needs no fragment shader at all
+        PipelineBuild build {
+            .info = pipelineInfo,
+            .stages = { shaderStageInfos[0], shaderStageInfos[1] },
+            .pipeline = &texturePipeline_.prepassPipelines[alphaTest]
+        };
+        build.info.stageCount = alphaTest ? 2 : 1;
+        build.info.pColorBlendState = &prepassBlendStateInfo;
+        build.stages[0].module = *depthShaderModule;
+        build.stages[1].module = *depthAlphaShaderModule;
+        builds.push_back(build);
+    }
+
+    for (auto& _build : builds) {
+        _build.info.pStages = _build.stages.data();
+        if (_build.specialization.dataSize) {
+            _build.specialization.pData = &_build.constants;
+            _build.stages[1].pSpecializationInfo = &_build.specialization;
+        }
+    }
+
+    // a worker per core takes the next build until none are left, the calling thread is one of them
+    std::atomic<size_t> nextBuild { 0 };
+    auto buildPipelines = [&] {
+        for (size_t i = nextBuild++; i < builds.size(); i = nextBuild++) {
+            PL_PROFILE_ZONE("Engine::createGraphicsPipeline");
+            *builds[i].pipeline = device_->createGraphicsPipelineUnique(pipelineCache_->get(), builds[i].info).value;
+        }
+    };
+    size_t workerCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, builds.size());
+    std::vector<std::future<void>> pending;
+    for (size_t i = 1; i < workerCount; i++) {
+        pending.push_back(std::async(std::launch::async, buildPipelines));
+    }
+    buildPipelines();
+    for (auto& _pending : pending) {
+        _pending.get();
+    }
 
     // shadow pass pipeline
     vk::PipelineShaderStageCreateInfo shadowPassStageInfo {
@@ -833,48 +1595,224 @@ void Engine::createPipelines()
         .pDynamicStates = dynamicStates.data()
     };
     pipelineInfo.renderPass = *shadowPass_.renderPass;
-    shadowPass_.pipeline = device_->createGraphicsPipelineUnique(nullptr, pipelineInfo).value;
-}
+    shadowPass_.pipeline = device_->createGraphicsPipelineUnique(pipelineCache_->get(), pipelineInfo).value;
 
-void Engine::createStorageBuffers()
-{
-    // uniform buffers
-    uniformBuffers_.resize(sConcurrentFrames_);
-    for (int i = 0; i < sConcurrentFrames_; i++) {
-        uniformBuffers_[i].buffer = memoryHelper_->createBuffer(sizeof(ubo_), vk::BufferUsageFlagBits::eUniformBuffer, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-    }
-}
+    if (isGpuDriven_) {
+        // culling pipeline
+        std::vector<char> cullShaderBytes = readSpirVFile("shaders/cull.spv");
+        vk::UniqueShaderModule cullShaderModule = device_->createShaderModuleUnique({ .codeSize = cullShaderBytes.size(),
+            .pCode = reinterpret_cast<const uint32_t*>(cullShaderBytes.data()) });
 
-void Engine::createSwapchain(vk::SwapchainKHR oldSwapchain)
+        vk::PushConstantRange cullPushConstantRange {
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            .offset = 0,
+            .size = sizeof(CullPushConstants)
+        };
+        vk::PipelineLayoutCreateInfo cullPipelineLayoutInfo {
+            .setLayoutCount = 1,
+            .pSetLayouts = &gpuDriven_.descriptorLayout.get(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &cullPushConstantRange
+        };
+        gpuDriven_.pipelineLayout = device_->createPipelineLayoutUnique(cullPipelineLayoutInfo);
+
+        vk::ComputePipelineCreateInfo cullPipelineInfo {
+            .stage = {
+                .stage = vk::ShaderStageFlagBits::eCompute,
+                .module = *cullShaderModule,
+                .pName = "main" },
+            .layout = *gpuDriven_.pipelineLayout
+        };
+        gpuDriven_.cullPipeline = device_->createComputePipelineUnique(pipelineCache_->get(), cullPipelineInfo).value;
+
+        // depth pyramid pipelines
+        std::vector<char> pyramidInitShaderBytes = readSpirVFile("shaders/depth_pyramid_init.spv");
+        vk::UniqueShaderModule pyramidInitShaderModule = device_->createShaderModuleUnique({ .codeSize = pyramidInitShaderBytes.size(),
+            .pCode = reinterpret_cast<const uint32_t*>(pyramidInitShaderBytes.data()) });
+
+        std::vector<char> pyramidShaderBytes = readSpirVFile("shaders/depth_pyramid.spv");
+        vk::UniqueShaderModule pyramidShaderModule = device_->createShaderModuleUnique({ .codeSize = pyramidShaderBytes.size(),
+            .pCode = reinterpret_cast<const uint32_t*>(pyramidShaderBytes.data()) });
+
+        vk::PushConstantRange reducePushConstantRange {
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            .offset = 0,
+            .size = sizeof(ReducePushConstants)
+        };
+        vk::PipelineLayoutCreateInfo reducePipelineLayoutInfo {
+            .setLayoutCount = 1,
+            .pSetLayouts = &occlusion_.descriptorLayout.get(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &reducePushConstantRange
+        };
+        occlusion_.pipelineLayout = device_->createPipelineLayoutUnique(reducePipelineLayoutInfo);
+
+        cullPipelineInfo.layout = *occlusion_.pipelineLayout;
+        cullPipelineInfo.stage.module = *pyramidInitShaderModule;
+        occlusion_.initPipeline = device_->createComputePipelineUnique(pipelineCache_->get(), cullPipelineInfo).value;
+        cullPipelineInfo.stage.module = *pyramidShaderModule;
+        occlusion_.reducePipeline = device_->createComputePipelineUnique(pipelineCache_->get(), cullPipelineInfo).value;
+    }
+}
+
+void Engine::createStorageBuffers()
 {
-    // multisampling
-    colorImage_ = memoryHelper_->createImage(extent_, sSwapchainFormat_, vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eColorAttachment, 1, sMsaaSamples_);
-    colorImageView_ = memoryHelper_->createImageViewUnique(colorImage_->image, sSwapchainFormat_, vk::ImageAspectFlagBits::eColor, 1);
+    // uniform buffers
+    uniformBuffers_.resize(sConcurrentFrames_);
+    for (int i = 0; i < sConcurrentFrames_; i++) {
+        uniformBuffers_[i].buffer = memoryHelper_->createBuffer(sizeof(ubo_), vk::BufferUsageFlagBits::eUniformBuffer, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    }
+}
 
-    // swapchain
-    vk::SurfaceCapabilitiesKHR capabilities = physicalDevice_.getSurfaceCapabilitiesKHR(*surface_);
-    vk::Extent2D swapchainExtent {
-        std::clamp(extent_.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
-        std::clamp(extent_.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height)
-    };
+void Engine::createTransformBuffers()
+{
+    transforms_.resize(model_->instances.size());
+    transformVersion_ = ~0ull;
+    updateTransforms();
+    for (auto& _uniformBuffer : uniformBuffers_) {
+        _uniformBuffer.transformBuffer = memoryHelper_->createBuffer(transforms_.size() * sizeof(DrawTransform), vk::BufferUsageFlagBits::eStorageBuffer, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        _uniformBuffer.transformVersion = ~0ull;
+    }
+}
 
-    vk::SwapchainCreateInfoKHR swapChainInfo {
-        .surface = *surface_,
-        .minImageCount = capabilities.minImageCount + 1,
-        .imageFormat = sSwapchainFormat_,
-        .imageExtent = swapchainExtent,
-        .imageArrayLayers = 1,
-        .imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
-        .imageSharingMode = vk::SharingMode::eExclusive,
-        .preTransform = vk::SurfaceTransformFlagBitsKHR::eIdentity,
-        .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
-        .presentMode = vk::PresentModeKHR::eMailbox,
-        .clipped = VK_TRUE,
-        .oldSwapchain = oldSwapchain
-    };
+void Engine::createGpuDrivenResources()
+{
+    // one batch per material, draw slots laid out contiguously by batch
+    const auto& instances = model_->instances;
+    gpuDriven_.instanceCount = static_cast<uint32_t>(instances.size());
+    gpuDriven_.batches.resize(model_->materials.size());
+    for (const auto& _material : model_->materials) {
+        gpuDriven_.batches[_material->index] = { _material.get(), 0, 0 };
+    }
+    for (const auto& _instance : instances) {
+        gpuDriven_.batches[_instance.primitive->material->index].maxDraws++;
+    }
+    uint32_t firstDraw = 0;
+    for (auto& _batch : gpuDriven_.batches) {
+        _batch.firstDraw = firstDraw;
+        firstDraw += _batch.maxDraws;
+    }
+    gpuDriven_.batchOrder.resize(gpuDriven_.batches.size());
+    std::iota(gpuDriven_.batchOrder.begin(), gpuDriven_.batchOrder.end(), 0);
+    std::stable_sort(gpuDriven_.batchOrder.begin(), gpuDriven_.batchOrder.end(), [&](uint32_t a, uint32_t b) {
+        return materialVariant(*gpuDriven_.batches[a].material) < materialVariant(*gpuDriven_.batches[b].material);
+    });
+
+    auto& gpuInstances = gpuDriven_.instances;
+    gpuInstances.resize(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        const auto& _instance = instances[i];
+        auto& gpuInstance = gpuInstances[i];
+
+        gpuInstance.boundsMin = glm::vec4(_instance.min, 1.0f);
+        gpuInstance.boundsMax = glm::vec4(_instance.max, 1.0f);
+        gpuInstance.firstIndex = _instance.primitive->firstIndex;
+        gpuInstance.indexCount = _instance.primitive->indexCount;
+        gpuInstance.batch = _instance.primitive->material->index;
+        gpuInstance.drawOffset = gpuDriven_.batches[gpuInstance.batch].firstDraw;
+    }
+
+    gpuDriven_.instanceBuffer = memoryHelper_->createBuffer(gpuInstances.size() * sizeof(GpuInstance), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, {});
+    memoryHelper_->uploadToBuffer(gpuDriven_.instanceBuffer, gpuInstances.data());
+    gpuDriven_.transformVersion = model_->transformVersion;
+
+    // shadow draws, color draws, late color draws
+    // shadow count, one count per batch for each color phase
+    gpuDriven_.frames.resize(sConcurrentFrames_);
+    for (auto& _frame : gpuDriven_.frames) {
+        _frame.drawBuffer = memoryHelper_->createBuffer(3 * gpuInstances.size() * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, {});
+        _frame.countBuffer = memoryHelper_->createBuffer((1 + 2 * gpuDriven_.batches.size()) * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, {});
+        if (model_->hasDynamicInstances)
+            _frame.instanceStaging = memoryHelper_->createBuffer(gpuInstances.size() * sizeof(GpuInstance), vk::BufferUsageFlagBits::eTransferSrc, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    }
+
+    // visibility from the previous frame, nothing is visible before the first frame
+    std::vector<uint32_t> visibility(gpuInstances.size(), 0);
+    occlusion_.visibilityBuffer = memoryHelper_->createBuffer(visibility.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, {});
+    memoryHelper_->uploadToBuffer(occlusion_.visibilityBuffer, visibility.data());
+}
+
+void Engine::createSceneTargets()
+{
+    renderExtent_ = extent_;
+    if (isRenderScaled_) {
+        renderExtent_.width = std::max(static_cast<uint32_t>(std::ceil((float)extent_.width * renderScale_)), 1u);
+        renderExtent_.height = std::max(static_cast<uint32_t>(std::ceil((float)extent_.height * renderScale_)), 1u);
+    }
+
+    // multisampled color and depth at the render extent, kept while it fits
+    bool isAttachmentReused = depthImage_ && isExtentReusable(attachmentExtent_, renderExtent_);
+    if (!isAttachmentReused) {
+        if (depthImage_)
+            retireAttachments();
+
+        // headless images are never resized
+        attachmentExtent_ = roundUpExtent(renderExtent_, isHeadless_ ? 1 : sAttachmentGranularity_);
+
+        if (msaaSamples_ != vk::SampleCountFlagBits::e1) {
+            colorImage_ = memoryHelper_->createImage(attachmentExtent_, sSwapchainFormat_, vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eColorAttachment, 1, msaaSamples_);
+            colorImageView_ = memoryHelper_->createImageViewUnique(colorImage_->image, sSwapchainFormat_, vk::ImageAspectFlagBits::eColor, 1);
+        }
 
-    swapchain_ = device_->createSwapchainKHRUnique(swapChainInfo);
-    swapchainImages_ = device_->getSwapchainImagesKHR(*swapchain_);
+        vk::ImageUsageFlags depthUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        if (isGpuDriven_)
+            depthUsage |= vk::ImageUsageFlagBits::eSampled;
+        depthImage_ = memoryHelper_->createImage(attachmentExtent_, sDepthAttachmentFormat_, depthUsage, 1, msaaSamples_);
+        depthView_ = memoryHelper_->createImageViewUnique(depthImage_->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 1);
+    }
+
+    // the offscreen scene image and framebuffer, the upscale target follows the window
+    if (isSceneOffscreen_)
+        createUpscaleTargets(isAttachmentReused);
+
+    // the pyramid follows the scene only when its power of two size or its depth source changes
+    bool isPyramidResized = occlusion_.width != std::bit_floor(std::max(renderExtent_.width, 1u)) || occlusion_.height != std::bit_floor(std::max(renderExtent_.height, 1u));
+    if (isGpuDriven_ && (!isAttachmentReused || isPyramidResized))
+        createDepthPyramid();
+}
+
+void Engine::createSwapchain(vk::SwapchainKHR oldSwapchain)
+{
+    createSceneTargets();
+
+    // swapchain, headless rendering resolves into one offscreen image per frame in flight
+    // a render scale copies the upscaled image into it
+    vk::Extent2D swapchainExtent { extent_.width, extent_.height };
+    vk::ImageUsageFlags swapchainUsage = vk::ImageUsageFlagBits::eColorAttachment;
+    if (isSceneOffscreen_)
+        swapchainUsage |= vk::ImageUsageFlagBits::eTransferDst;
+    if (isHeadless_) {
+        offscreenImages_.resize(sConcurrentFrames_);
+        swapchainImages_.resize(sConcurrentFrames_);
+        for (size_t i = 0; i < sConcurrentFrames_; i++) {
+            offscreenImages_[i] = memoryHelper_->createImage(extent_, sSwapchainFormat_, swapchainUsage | vk::ImageUsageFlagBits::eTransferSrc, 1, vk::SampleCountFlagBits::e1);
+            swapchainImages_[i] = offscreenImages_[i]->image;
+        }
+    } else {
+        vk::SurfaceCapabilitiesKHR capabilities = physicalDevice_.getSurfaceCapabilitiesKHR(*surface_);
+        swapchainExtent = vk::Extent2D {
+            std::clamp(extent_.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+            std::clamp(extent_.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height)
+        };
+
+        vk::SwapchainCreateInfoKHR swapChainInfo {
+            .surface = *surface_,
+            .minImageCount = capabilities.minImageCount + 1,
+            .imageFormat = sSwapchainFormat_,
+            .imageExtent = swapchainExtent,
+            .imageArrayLayers = 1,
+            .imageUsage = swapchainUsage,
+            .imageSharingMode = vk::SharingMode::eExclusive,
+            .preTransform = vk::SurfaceTransformFlagBitsKHR::eIdentity,
+            .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
+            .presentMode = vk::PresentModeKHR::eMailbox,
+            .clipped = VK_TRUE,
+            .oldSwapchain = oldSwapchain
+        };
+
+        swapchain_ = device_->createSwapchainKHRUnique(swapChainInfo);
+        swapchainImages_ = device_->getSwapchainImagesKHR(*swapchain_);
+    }
 
     // image views
     swapchainImageViews_.resize(swapchainImages_.size());
@@ -882,24 +1820,426 @@ void Engine::createSwapchain(vk::SwapchainKHR oldSwapchain)
         swapchainImageViews_[i] = memoryHelper_->createImageViewUnique(swapchainImages_[i], sSwapchainFormat_, vk::ImageAspectFlagBits::eColor, 1);
     }
 
-    // depth buffer
-    depthImage_ = memoryHelper_->createImage(extent_, sDepthAttachmentFormat_, vk::ImageUsageFlagBits::eDepthStencilAttachment, 1, sMsaaSamples_);
-    depthView_ = memoryHelper_->createImageViewUnique(depthImage_->image, sDepthAttachmentFormat_, vk::ImageAspectFlagBits::eDepth, 1);
+    // framebuffers, attachments may be larger than the swapchain, with a render scale
+    // the scene has its own and the swapchain ones only take the ImGui pass
+    if (isSceneOffscreen_) {
+        if (!isHeadless_) {
+            swapchainFramebuffers_.resize(swapchainImages_.size());
+            for (size_t i = 0; i < swapchainImages_.size(); i++) {
+                vk::FramebufferCreateInfo framebufferInfo {
+                    .renderPass = *upscale_.uiRenderPass,
+                    .attachmentCount = 1,
+                    .pAttachments = &swapchainImageViews_[i].get(),
+                    .width = swapchainExtent.width,
+                    .height = swapchainExtent.height,
+                    .layers = 1
+                };
+                swapchainFramebuffers_[i] = device_->createFramebufferUnique(framebufferInfo);
+            }
+        }
+    } else {
+        swapchainFramebuffers_.resize(swapchainImages_.size());
+        for (size_t i = 0; i < swapchainImages_.size(); i++) {
+            std::vector<vk::ImageView> attachments = colorPassAttachments(*swapchainImageViews_[i]);
+            vk::FramebufferCreateInfo framebufferInfo {
+                .renderPass = *renderPass_,
+                .attachmentCount = static_cast<uint32_t>(attachments.size()),
+                .pAttachments = attachments.data(),
+                .width = swapchainExtent.width,
+                .height = swapchainExtent.height,
+                .layers = 1
+            };
+            swapchainFramebuffers_[i] = device_->createFramebufferUnique(framebufferInfo);
+        }
+    }
+}
+
+void Engine::createDepthPyramid()
+{
+    if (occlusion_.pyramid) {
+        auto& retired = retireResources();
+        retired.views.push_back(std::move(occlusion_.pyramidView));
+        for (auto& _view : occlusion_.mipViews)
+            retired.views.push_back(std::move(_view));
+        retired.descriptorPools.push_back(std::move(occlusion_.descriptorPool));
+        for (auto& _set : occlusion_.descriptorSets)
+            retired.descriptorSets.push_back(std::move(_set));
+        retired.images.push_back(occlusion_.pyramid);
+        occlusion_.mipViews.clear();
+    }
 
-    // framebuffers
-    swapchainFramebuffers_.resize(swapchainImages_.size());
-    for (size_t i = 0; i < swapchainImages_.size(); i++) {
-        std::array<vk::ImageView, 3> attachments = { *colorImageView_, *depthView_, *swapchainImageViews_[i] };
+    // previous power of two, every level halves exactly
+    occlusion_.width = std::bit_floor(std::max(renderExtent_.width, 1u));
+    occlusion_.height = std::bit_floor(std::max(renderExtent_.height, 1u));
+    occlusion_.mipLevels = std::bit_width(std::max(occlusion_.width, occlusion_.height));
+
+    vk::Extent3D extent { .width = occlusion_.width, .height = occlusion_.height, .depth = 1 };
+    occlusion_.pyramid = memoryHelper_->createImage(extent, vk::Format::eR32Sfloat, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, occlusion_.mipLevels, vk::SampleCountFlagBits::e1);
+    occlusion_.pyramidView = memoryHelper_->createImageViewUnique(occlusion_.pyramid->image, vk::Format::eR32Sfloat, vk::ImageAspectFlagBits::eColor, occlusion_.mipLevels);
+    occlusion_.mipViews.resize(occlusion_.mipLevels);
+    for (uint32_t i = 0; i < occlusion_.mipLevels; i++) {
+        occlusion_.mipViews[i] = memoryHelper_->createImageViewUnique(occlusion_.pyramid->image, vk::Format::eR32Sfloat, vk::ImageAspectFlagBits::eColor, 1, i);
+    }
+
+    if (!occlusion_.sampler) {
+        vk::SamplerCreateInfo samplerInfo {
+            .magFilter = vk::Filter::eNearest,
+            .minFilter = vk::Filter::eNearest,
+            .mipmapMode = vk::SamplerMipmapMode::eNearest,
+            .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+            .mipLodBias = 0.0f,
+            .maxAnisotropy = 1.0f,
+            .minLod = 0.0f,
+            .maxLod = VK_LOD_CLAMP_NONE,
+            .borderColor = vk::BorderColor::eFloatOpaqueWhite
+        };
+        occlusion_.sampler = device_->createSamplerUnique(samplerInfo);
+    }
+
+    // the pyramid stays in the general layout, written and sampled by compute, the first
+    // build moves it there with the frame instead of a blocking one time submit
+    occlusion_.isPyramidUndefined = true;
+
+    // one set per level, the first level reads the depth buffer
+    occlusion_.descriptorSets.clear();
+    std::array<vk::DescriptorPoolSize, 2> reducePoolSizes {
+        vk::DescriptorPoolSize { .type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = occlusion_.mipLevels },
+        vk::DescriptorPoolSize { .type = vk::DescriptorType::eStorageImage, .descriptorCount = occlusion_.mipLevels }
+    };
+    vk::DescriptorPoolCreateInfo reducePoolInfo {
+        .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+        .maxSets = occlusion_.mipLevels,
+        .poolSizeCount = static_cast<uint32_t>(reducePoolSizes.size()),
+        .pPoolSizes = reducePoolSizes.data()
+    };
+    occlusion_.descriptorPool = device_->createDescriptorPoolUnique(reducePoolInfo);
+
+    std::vector<vk::DescriptorSetLayout> reduceLayouts(occlusion_.mipLevels, *occlusion_.descriptorLayout);
+    vk::DescriptorSetAllocateInfo reduceDescriptorSetInfo {
+        .descriptorPool = *occlusion_.descriptorPool,
+        .descriptorSetCount = occlusion_.mipLevels,
+        .pSetLayouts = reduceLayouts.data()
+    };
+    occlusion_.descriptorSets = device_->allocateDescriptorSetsUnique(reduceDescriptorSetInfo);
+
+    for (uint32_t i = 0; i < occlusion_.mipLevels; i++) {
+        vk::DescriptorImageInfo sourceInfo {
+            .sampler = *occlusion_.sampler,
+            .imageView = i == 0 ? *depthView_ : *occlusion_.mipViews[i - 1],
+            .imageLayout = i == 0 ? vk::ImageLayout::eDepthStencilReadOnlyOptimal : vk::ImageLayout::eGeneral
+        };
+        vk::DescriptorImageInfo targetInfo {
+            .imageView = *occlusion_.mipViews[i],
+            .imageLayout = vk::ImageLayout::eGeneral
+        };
+        std::array<vk::WriteDescriptorSet, 2> reduceWriteDescriptors {
+            vk::WriteDescriptorSet {
+                .dstSet = *occlusion_.descriptorSets[i],
+                .dstBinding = 0,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                .pImageInfo = &sourceInfo },
+            vk::WriteDescriptorSet {
+                .dstSet = *occlusion_.descriptorSets[i],
+                .dstBinding = 1,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eStorageImage,
+                .pImageInfo = &targetInfo }
+        };
+        device_->updateDescriptorSets(static_cast<uint32_t>(reduceWriteDescriptors.size()), reduceWriteDescriptors.data(), 0, nullptr);
+    }
+
+    // cull sets already exist when the swapchain is recreated, a frame still in flight may be using its set
+    for (auto& _frame : gpuDriven_.frames)
+        _frame.isPyramidStale = static_cast<bool>(_frame.descriptorSet);
+}
+
+void Engine::updatePyramidDescriptor(vk::DescriptorSet descriptorSet)
+{
+    vk::DescriptorImageInfo pyramidInfo {
+        .sampler = *occlusion_.sampler,
+        .imageView = *occlusion_.pyramidView,
+        .imageLayout = vk::ImageLayout::eGeneral
+    };
+    vk::WriteDescriptorSet pyramidWriteDescriptor {
+        .dstSet = descriptorSet,
+        .dstBinding = 5,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &pyramidInfo
+    };
+    device_->updateDescriptorSets(1, &pyramidWriteDescriptor, 0, nullptr);
+}
+
+void Engine::createUpscaler()
+{
+    // resolved scene, upscaled target
+    std::array<vk::DescriptorSetLayoutBinding, 2> upscaleLayoutBindings {
+        vk::DescriptorSetLayoutBinding {
+            .binding = 0,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute },
+        vk::DescriptorSetLayoutBinding {
+            .binding = 1,
+            .descriptorType = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute }
+    };
+    vk::DescriptorSetLayoutCreateInfo upscaleDescriptorLayoutInfo {
+        .bindingCount = static_cast<uint32_t>(upscaleLayoutBindings.size()),
+        .pBindings = upscaleLayoutBindings.data()
+    };
+    upscale_.descriptorLayout = device_->createDescriptorSetLayoutUnique(upscaleDescriptorLayoutInfo);
+
+    std::vector<char> upscaleShaderBytes = readSpirVFile("shaders/upscale.spv");
+    vk::UniqueShaderModule upscaleShaderModule = device_->createShaderModuleUnique({ .codeSize = upscaleShaderBytes.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(upscaleShaderBytes.data()) });
+
+    vk::PushConstantRange upscalePushConstantRange {
+        .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        .offset = 0,
+        .size = sizeof(UpscalePushConstants)
+    };
+    vk::PipelineLayoutCreateInfo upscalePipelineLayoutInfo {
+        .setLayoutCount = 1,
+        .pSetLayouts = &upscale_.descriptorLayout.get(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &upscalePushConstantRange
+    };
+    upscale_.pipelineLayout = device_->createPipelineLayoutUnique(upscalePipelineLayoutInfo);
+
+    vk::ComputePipelineCreateInfo upscalePipelineInfo {
+        .stage = {
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = *upscaleShaderModule,
+            .pName = "main" },
+        .layout = *upscale_.pipelineLayout
+    };
+    upscale_.pipeline = device_->createComputePipelineUnique(pipelineCache_->get(), upscalePipelineInfo).value;
+
+    std::vector<char> postAaShaderBytes = readSpirVFile("shaders/post_aa.spv");
+    vk::UniqueShaderModule postAaShaderModule = device_->createShaderModuleUnique({ .codeSize = postAaShaderBytes.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(postAaShaderBytes.data()) });
+    upscalePipelineInfo.stage.module = *postAaShaderModule;
+    upscale_.postAaPipeline = device_->createComputePipelineUnique(pipelineCache_->get(), upscalePipelineInfo).value;
+
+    // the upscaler fetches texels, post aa filters between them
+    vk::SamplerCreateInfo samplerInfo {
+        .magFilter = vk::Filter::eLinear,
+        .minFilter = vk::Filter::eLinear,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+        .maxAnisotropy = 1.0f
+    };
+    upscale_.sampler = device_->createSamplerUnique(samplerInfo);
+
+    // ImGui at full resolution over the copied in upscaled image
+    if (!isHeadless_) {
+        vk::AttachmentDescription swapchainAttachment {
+            .format = sSwapchainFormat_,
+            .samples = vk::SampleCountFlagBits::e1,
+            .loadOp = vk::AttachmentLoadOp::eLoad,
+            .storeOp = vk::AttachmentStoreOp::eStore,
+            .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+            .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+            .initialLayout = vk::ImageLayout::eTransferDstOptimal,
+            .finalLayout = vk::ImageLayout::ePresentSrcKHR
+        };
+        vk::AttachmentReference swapchainAttachmentRef {
+            .attachment = 0,
+            .layout = vk::ImageLayout::eColorAttachmentOptimal
+        };
+        vk::SubpassDescription subpass {
+            .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &swapchainAttachmentRef
+        };
+        vk::SubpassDependency dependency {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = vk::PipelineStageFlagBits::eTransfer,
+            .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+        };
+        vk::RenderPassCreateInfo renderPassInfo {
+            .attachmentCount = 1,
+            .pAttachments = &swapchainAttachment,
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = 1,
+            .pDependencies = &dependency
+        };
+        upscale_.uiRenderPass = device_->createRenderPassUnique(renderPassInfo);
+    }
+}
+
+void Engine::createUpscaleTargets(bool isAttachmentReused)
+{
+    if (!isAttachmentReused) {
+        if (upscale_.sceneImage) {
+            auto& retired = retireResources();
+            retired.framebuffers.push_back(std::move(upscale_.sceneFramebuffer));
+            retired.views.push_back(std::move(upscale_.sceneView));
+            retired.images.push_back(upscale_.sceneImage);
+        }
+
+        upscale_.sceneImage = memoryHelper_->createImage(attachmentExtent_, sSwapchainFormat_, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, 1, vk::SampleCountFlagBits::e1);
+        upscale_.sceneView = memoryHelper_->createImageViewUnique(upscale_.sceneImage->image, sSwapchainFormat_, vk::ImageAspectFlagBits::eColor, 1);
+
+        // sized like the attachments, the render area picks the render extent out of them
+        std::vector<vk::ImageView> attachments = colorPassAttachments(*upscale_.sceneView);
         vk::FramebufferCreateInfo framebufferInfo {
             .renderPass = *renderPass_,
             .attachmentCount = static_cast<uint32_t>(attachments.size()),
             .pAttachments = attachments.data(),
-            .width = swapchainExtent.width,
-            .height = swapchainExtent.height,
+            .width = attachmentExtent_.width,
+            .height = attachmentExtent_.height,
             .layers = 1
         };
-        swapchainFramebuffers_[i] = device_->createFramebufferUnique(framebufferInfo);
+        upscale_.sceneFramebuffer = device_->createFramebufferUnique(framebufferInfo);
     }
+
+    // rgba8 is always a storage format, the bgra swapchain formats are not
+    bool isTargetReused = upscale_.targetImage && isExtentReusable(upscale_.targetExtent, extent_);
+    if (!isTargetReused) {
+        if (upscale_.targetImage) {
+            auto& retired = retireResources();
+            retired.views.push_back(std::move(upscale_.targetView));
+            retired.images.push_back(upscale_.targetImage);
+        }
+
+        upscale_.targetExtent = roundUpExtent(extent_, isHeadless_ ? 1 : sAttachmentGranularity_);
+        upscale_.targetImage = memoryHelper_->createImage(upscale_.targetExtent, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc, 1, vk::SampleCountFlagBits::e1);
+        upscale_.targetView = memoryHelper_->createImageViewUnique(upscale_.targetImage->image, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, 1);
+    }
+
+    if (isAttachmentReused && isTargetReused)
+        return;
+
+    // a new set, the old one may still be bound by a frame in flight
+    if (upscale_.descriptorPool) {
+        auto& retired = retireResources();
+        retired.descriptorPools.push_back(std::move(upscale_.descriptorPool));
+        retired.descriptorSets.push_back(std::move(upscale_.descriptorSet));
+    }
+
+    std::array<vk::DescriptorPoolSize, 2> upscalePoolSizes {
+        vk::DescriptorPoolSize { .type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = 1 },
+        vk::DescriptorPoolSize { .type = vk::DescriptorType::eStorageImage, .descriptorCount = 1 }
+    };
+    vk::DescriptorPoolCreateInfo upscalePoolInfo {
+        .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(upscalePoolSizes.size()),
+        .pPoolSizes = upscalePoolSizes.data()
+    };
+    upscale_.descriptorPool = device_->createDescriptorPoolUnique(upscalePoolInfo);
+
+    vk::DescriptorSetAllocateInfo upscaleDescriptorSetInfo {
+        .descriptorPool = *upscale_.descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &upscale_.descriptorLayout.get()
+    };
+    upscale_.descriptorSet = std::move(device_->allocateDescriptorSetsUnique(upscaleDescriptorSetInfo)[0]);
+
+    vk::DescriptorImageInfo sourceInfo {
+        .sampler = *upscale_.sampler,
+        .imageView = *upscale_.sceneView,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    vk::DescriptorImageInfo targetInfo {
+        .imageView = *upscale_.targetView,
+        .imageLayout = vk::ImageLayout::eGeneral
+    };
+    std::array<vk::WriteDescriptorSet, 2> upscaleWriteDescriptors {
+        vk::WriteDescriptorSet {
+            .dstSet = *upscale_.descriptorSet,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &sourceInfo },
+        vk::WriteDescriptorSet {
+            .dstSet = *upscale_.descriptorSet,
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageImage,
+            .pImageInfo = &targetInfo }
+    };
+    device_->updateDescriptorSets(static_cast<uint32_t>(upscaleWriteDescriptors.size()), upscaleWriteDescriptors.data(), 0, nullptr);
+}
+
+void Engine::createLightClusters()
+{
+    // lights, clusters
+    std::array<vk::DescriptorSetLayoutBinding, 2> clusterLayoutBindings;
+    for (uint32_t i = 0; i < clusterLayoutBindings.size(); i++) {
+        clusterLayoutBindings[i] = {
+            .binding = i,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute
+        };
+    }
+    vk::DescriptorSetLayoutCreateInfo clusterDescriptorLayoutInfo {
+        .bindingCount = static_cast<uint32_t>(clusterLayoutBindings.size()),
+        .pBindings = clusterLayoutBindings.data()
+    };
+    clusters_.descriptorLayout = device_->createDescriptorSetLayoutUnique(clusterDescriptorLayoutInfo);
+
+    std::vector<char> clusterShaderBytes = readSpirVFile("shaders/cluster_lights.spv");
+    vk::UniqueShaderModule clusterShaderModule = device_->createShaderModuleUnique({ .codeSize = clusterShaderBytes.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(clusterShaderBytes.data()) });
+
+    vk::PushConstantRange clusterPushConstantRange {
+        .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        .offset = 0,
+        .size = sizeof(ClusterPushConstants)
+    };
+    vk::PipelineLayoutCreateInfo clusterPipelineLayoutInfo {
+        .setLayoutCount = 1,
+        .pSetLayouts = &clusters_.descriptorLayout.get(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &clusterPushConstantRange
+    };
+    clusters_.pipelineLayout = device_->createPipelineLayoutUnique(clusterPipelineLayoutInfo);
+
+    vk::ComputePipelineCreateInfo clusterPipelineInfo {
+        .stage = {
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = *clusterShaderModule,
+            .pName = "main" },
+        .layout = *clusters_.pipelineLayout
+    };
+    clusters_.pipeline = device_->createComputePipelineUnique(pipelineCache_->get(), clusterPipelineInfo).value;
+}
+
+void Engine::createLightBuffers()
+{
+    // at least one of each so the sets are always complete, without lights the clusters are never read
+    const auto& lights = model_->defaultScene->lights;
+    clusters_.lights.resize(std::max<size_t>(lights.size(), 1));
+    size_t clusterSize = (lights.empty() ? 1 : sClusterCount_) * (1 + sMaxClusterLights_) * sizeof(uint32_t);
+    clusters_.transformVersion = ~0ull;
+    for (auto& _uniformBuffer : uniformBuffers_) {
+        _uniformBuffer.lightBuffer = memoryHelper_->createBuffer(clusters_.lights.size() * sizeof(GpuLight), vk::BufferUsageFlagBits::eStorageBuffer, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        _uniformBuffer.lightVersion = ~0ull;
+        _uniformBuffer.clusterBuffer = memoryHelper_->createBuffer(clusterSize, vk::BufferUsageFlagBits::eStorageBuffer, {});
+    }
+
+    char line[64];
+    snprintf(line, sizeof(line), "%zu point and spot lights", lights.size());
+    LOG_INFO(line, "GFX");
 }
 
 void Engine::createGpuSync()
@@ -911,6 +2251,18 @@ void Engine::createGpuSync()
     }
 }
 
+void Engine::createGpuProfiler()
+{
+    pl::GpuProfilerCreateInfo profilerInfo {
+        .physicalDevice = physicalDevice_,
+        .device = *device_,
+        .queueFamily = queueFamilyIndices_.graphics,
+        .frameCount = sConcurrentFrames_
+    };
+
+    gpuProfiler_ = createGpuProfilerUnique(profilerInfo);
+}
+
 void Engine::initImGui()
 {
     vk::DescriptorPoolSize imguiPoolSizes[] = {
@@ -938,19 +2290,27 @@ void Engine::initImGui()
 
     ImGui::CreateContext();
     ImGui_ImplSDL2_InitForVulkan(window_);
+    initImGuiRenderer();
+}
 
+// the ImGui pipeline is built for its render pass and sample count, so it is reinitialized
+// when anti-aliasing changes them
+void Engine::initImGuiRenderer()
+{
     ImGui_ImplVulkan_InitInfo imguiInfo {
         .Instance = *instance_,
         .PhysicalDevice = physicalDevice_,
         .Device = *device_,
         .Queue = graphicsQueue_,
+        .PipelineCache = pipelineCache_->get(),
         .DescriptorPool = *imguiDescriptorPool_,
         .MinImageCount = 3,
         .ImageCount = 3,
-        .MSAASamples = VK_SAMPLE_COUNT_4_BIT
+        // an offscreen scene leaves ImGui its own single sampled pass
+        .MSAASamples = isSceneOffscreen_ ? VK_SAMPLE_COUNT_1_BIT : static_cast<VkSampleCountFlagBits>(msaaSamples_)
     };
 
-    ImGui_ImplVulkan_Init(&imguiInfo, *renderPass_);
+    ImGui_ImplVulkan_Init(&imguiInfo, isSceneOffscreen_ ? *upscale_.uiRenderPass : *renderPass_);
     auto cmd = beginOneTimeCommandBuffer();
     ImGui_ImplVulkan_CreateFontsTexture(*cmd);
     endOneTimeCommandBuffer(*cmd);
@@ -961,6 +2321,11 @@ void Engine::createDescriptorPool()
 {
     uint32_t uboCount = 2;
     uint32_t samplerCount = 2 + 2 * static_cast<uint32_t>(model_->materials.size());
+    // frame ubo and depth pyramid in each cull set
+    if (isGpuDriven_) {
+        uboCount += sConcurrentFrames_;
+        samplerCount += sConcurrentFrames_;
+    }
 
     vk::DescriptorPoolSize uboSize {
         .type = vk::DescriptorType::eUniformBuffer,
@@ -970,11 +2335,18 @@ void Engine::createDescriptorPool()
         .type = vk::DescriptorType::eCombinedImageSampler,
         .descriptorCount = samplerCount
     };
-    std::array<vk::DescriptorPoolSize, 2> pipelinePoolSizes { uboSize, samplerSize };
+    // transform, light and cluster buffers in each ubo set, instance, draw, count and visibility
+    // buffers in each cull set, light and cluster buffers in each cluster set
+    uint32_t storageCount = 9 * sConcurrentFrames_;
+    vk::DescriptorPoolSize storageSize {
+        .type = vk::DescriptorType::eStorageBuffer,
+        .descriptorCount = storageCount
+    };
+    std::array<vk::DescriptorPoolSize, 3> pipelinePoolSizes { uboSize, samplerSize, storageSize };
 
     vk::DescriptorPoolCreateInfo pipelinePoolInfo {
         .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-        .maxSets = uboCount + samplerCount,
+        .maxSets = uboCount + samplerCount + 2 * sConcurrentFrames_,
         .poolSizeCount = static_cast<uint32_t>(pipelinePoolSizes.size()),
         .pPoolSizes = pipelinePoolSizes.data()
     };
@@ -1018,8 +2390,120 @@ void Engine::createDescriptorSets()
             .descriptorType = vk::DescriptorType::eCombinedImageSampler,
             .pImageInfo = &shadowMapSamplerInfo
         };
-        std::array<vk::WriteDescriptorSet, 2> uboWriteDescriptors = { sceneUboWriteDescriptor, shadowMapWriteDescriptor };
+        vk::DescriptorBufferInfo transformBufferInfo {
+            .buffer = uniformBuffers_[i].transformBuffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        };
+        vk::WriteDescriptorSet transformWriteDescriptor {
+            .dstSet = *uniformBuffers_[i].descriptorSet,
+            .dstBinding = 2,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &transformBufferInfo
+        };
+        vk::DescriptorBufferInfo lightBufferInfo {
+            .buffer = uniformBuffers_[i].lightBuffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        };
+        vk::DescriptorBufferInfo clusterBufferInfo {
+            .buffer = uniformBuffers_[i].clusterBuffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        };
+        vk::WriteDescriptorSet lightWriteDescriptor {
+            .dstSet = *uniformBuffers_[i].descriptorSet,
+            .dstBinding = 3,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &lightBufferInfo
+        };
+        vk::WriteDescriptorSet clusterWriteDescriptor {
+            .dstSet = *uniformBuffers_[i].descriptorSet,
+            .dstBinding = 4,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &clusterBufferInfo
+        };
+        std::array<vk::WriteDescriptorSet, 5> uboWriteDescriptors = { sceneUboWriteDescriptor, shadowMapWriteDescriptor, transformWriteDescriptor, lightWriteDescriptor, clusterWriteDescriptor };
         device_->updateDescriptorSets(static_cast<uint32_t>(uboWriteDescriptors.size()), uboWriteDescriptors.data(), 0, nullptr);
+
+        // the same buffers for the cluster pass
+        vk::DescriptorSetAllocateInfo clusterDescriptorSetInfo {
+            .descriptorPool = *descriptorPool_,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &clusters_.descriptorLayout.get()
+        };
+        clusters_.descriptorSets.push_back(std::move(device_->allocateDescriptorSetsUnique(clusterDescriptorSetInfo)[0]));
+        std::array<vk::WriteDescriptorSet, 2> clusterWriteDescriptors { lightWriteDescriptor, clusterWriteDescriptor };
+        for (uint32_t j = 0; j < clusterWriteDescriptors.size(); j++) {
+            clusterWriteDescriptors[j].dstSet = *clusters_.descriptorSets.back();
+            clusterWriteDescriptors[j].dstBinding = j;
+        }
+        device_->updateDescriptorSets(static_cast<uint32_t>(clusterWriteDescriptors.size()), clusterWriteDescriptors.data(), 0, nullptr);
+    }
+
+    // gpu driven descriptors
+    if (isGpuDriven_) {
+        vk::DescriptorBufferInfo instanceBufferInfo {
+            .buffer = gpuDriven_.instanceBuffer->buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        };
+        for (int i = 0; i < sConcurrentFrames_; i++) {
+            auto& frame = gpuDriven_.frames[i];
+            vk::DescriptorSetAllocateInfo cullDescriptorSetInfo {
+                .descriptorPool = *descriptorPool_,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &gpuDriven_.descriptorLayout.get()
+            };
+            frame.descriptorSet = std::move(device_->allocateDescriptorSetsUnique(cullDescriptorSetInfo)[0]);
+
+            std::array<vk::DescriptorBufferInfo, 4> cullBufferInfos {
+                instanceBufferInfo,
+                vk::DescriptorBufferInfo { .buffer = frame.drawBuffer->buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+                vk::DescriptorBufferInfo { .buffer = frame.countBuffer->buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+                vk::DescriptorBufferInfo { .buffer = occlusion_.visibilityBuffer->buffer, .offset = 0, .range = VK_WHOLE_SIZE }
+            };
+            vk::DescriptorBufferInfo cullUboInfo {
+                .buffer = uniformBuffers_[i].buffer->buffer,
+                .offset = 0,
+                .range = sizeof(ubo_)
+            };
+            vk::DescriptorImageInfo pyramidInfo {
+                .sampler = *occlusion_.sampler,
+                .imageView = *occlusion_.pyramidView,
+                .imageLayout = vk::ImageLayout::eGeneral
+            };
+            std::array<vk::WriteDescriptorSet, 3> cullWriteDescriptors {
+                vk::WriteDescriptorSet {
+                    .dstSet = *frame.descriptorSet,
+                    .dstBinding = 0,
+                    .dstArrayElement = 0,
+                    .descriptorCount = static_cast<uint32_t>(cullBufferInfos.size()),
+                    .descriptorType = vk::DescriptorType::eStorageBuffer,
+                    .pBufferInfo = cullBufferInfos.data() },
+                vk::WriteDescriptorSet {
+                    .dstSet = *frame.descriptorSet,
+                    .dstBinding = 4,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = vk::DescriptorType::eUniformBuffer,
+                    .pBufferInfo = &cullUboInfo },
+                vk::WriteDescriptorSet {
+                    .dstSet = *frame.descriptorSet,
+                    .dstBinding = 5,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                    .pImageInfo = &pyramidInfo }
+            };
+            device_->updateDescriptorSets(static_cast<uint32_t>(cullWriteDescriptors.size()), cullWriteDescriptors.data(), 0, nullptr);
+        }
     }
 
     // material descriptor sets
@@ -1104,93 +2588,865 @@ void Engine::endOneTimeCommandBuffer(vk::CommandBuffer& commandBuffer)
 
 void Engine::recreateSwapchain()
 {
-    device_->waitIdle();
+    PL_PROFILE_ZONE("Engine::recreateSwapchain");
     int width, height;
     SDL_GetWindowSize(window_, &width, &height);
+    // minimized, keep the old swapchain until there is something to draw into
+    if (width == 0 || height == 0)
+        return;
 
     extent_ = vk::Extent3D { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
 
-    createSwapchain(*swapchain_);
+    // no device wait, the old swapchain and what was built on it retire through the frame fences
+    auto& retired = retireResources();
+    retired.swapchain = std::move(swapchain_);
+    for (auto& _view : swapchainImageViews_)
+        retired.views.push_back(std::move(_view));
+    for (auto& _framebuffer : swapchainFramebuffers_)
+        retired.framebuffers.push_back(std::move(_framebuffer));
+    swapchainImageViews_.clear();
+    swapchainFramebuffers_.clear();
+
+    createSwapchain(*retired.swapchain);
     camera_.resize((float)extent_.width / (float)extent_.height);
 }
 
+void Engine::retireAttachments()
+{
+    auto& retired = retireResources();
+    if (colorImage_) {
+        retired.views.push_back(std::move(colorImageView_));
+        retired.images.push_back(colorImage_);
+        colorImage_ = nullptr;
+    }
+    retired.views.push_back(std::move(depthView_));
+    retired.images.push_back(depthImage_);
+    depthImage_ = nullptr;
+}
+
+std::vector<vk::ImageView> Engine::colorPassAttachments(vk::ImageView target) const
+{
+    // in render pass order, single sampled scenes draw into the target without a resolve
+    if (msaaSamples_ == vk::SampleCountFlagBits::e1)
+        return { target, *depthView_ };
+    return { *colorImageView_, *depthView_, target };
+}
+
+Engine::RetiredResources& Engine::retireResources()
+{
+    if (retired_.empty() || retired_.back().frame != frameNumber_)
+        retired_.push_back({ .frame = frameNumber_ });
+    return retired_.back();
+}
+
+void Engine::releaseRetired()
+{
+    // frames complete in submission order, so with this frame's fence signaled every
+    // frame up to frameNumber_ - sConcurrentFrames_ is done
+    while (!retired_.empty() && retired_.front().frame + sConcurrentFrames_ <= frameNumber_) {
+        std::vector<pl::VmaImage*> images = std::move(retired_.front().images);
+        retired_.pop_front();
+        for (auto _image : images)
+            memoryHelper_->destroyImage(_image);
+    }
+}
+
 void Engine::updateUniformBuffers(float dt)
 {
+    PL_PROFILE_ZONE("Engine::updateUniformBuffers");
+    // only animated scenes move nodes, the bounds and bvh follow them
+    if (model_->hasDynamicInstances)
+        model_->updateTransforms();
+
     // ubo_.lightPos = glm::rotate(ubo_.lightPos, dt*0.2f, glm::vec3(0.0f, 1.0f, 0.0f));
 
     ubo_.cameraView = camera_.view;
     ubo_.cameraProj = camera_.proj;
 
-    ubo_.lightView = glm::lookAt(glm::vec3(ubo_.lightPos), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo_.lightProj = glm::perspective(45.0f, 1.0f, 1.0f, 1000.0f);
+    // directional light, the cascades are fit around the camera frustum
+    ShadowCascadesCreateInfo cascadesInfo {
+        .camera = &camera_,
+        .lightDir = glm::vec3(ubo_.lightPos),
+        .sceneMin = glm::vec3(-1.0f),
+        .sceneMax = glm::vec3(1.0f),
+        .resolution = shadowPass_.width,
+        .distance = sShadowDistance_,
+        .splitLambda = sShadowSplitLambda_
+    };
+    if (!model_->bvh.empty()) {
+        cascadesInfo.sceneMin = model_->bvh.root().min;
+        cascadesInfo.sceneMax = model_->bvh.root().max;
+    }
+    shadowCascades_ = fitShadowCascades(cascadesInfo);
+
+    std::copy(shadowCascades_.viewProj.begin(), shadowCascades_.viewProj.end(), ubo_.cascadeViewProj);
+    ubo_.cascadeSplits = shadowCascades_.splits;
+    ubo_.qualityParams = glm::vec4((float)shadowPass_.width / (float)sShadowResolution_, lodBias_, 0.0f, 0.0f);
+
+    ubo_.lightParams = glm::uvec4(static_cast<uint32_t>(model_->defaultScene->lights.size()), 0, 0, 0);
 
-    memoryHelper_->uploadToBufferDirect(uniformBuffers_[currentFrame_].buffer, &ubo_);
+    updateTransforms();
+    if (ubo_.lightParams.x > 0)
+        updateLights();
 }
 
-void Engine::drawNode(vk::CommandBuffer& commandBuffer, pl::Node* node)
+void Engine::uploadUniformBuffers()
 {
-    if (node->mesh != nullptr && !node->mesh->primitives.empty()) {
-        pushConstants_.meshTransform = node->globalMatrix;
-        for (const auto& _primitive : node->mesh->primitives) {
-            if (_primitive->indexCount > 0) {
-                if (_primitive->material->baseColor) {
-                    std::array<vk::DescriptorSet, 2> descriptorSets {
-                        uniformBuffers_[currentFrame_].descriptorSet.get(),
-                        _primitive->material->descriptorSet.get()
-                    };
-                    pushConstants_.useNormalTexture = _primitive->material->useNormalTexture;
-                    commandBuffer.pushConstants(*texturePipeline_.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants), &pushConstants_);
-                    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *texturePipeline_.layout, 0, 2, descriptorSets.data(), 0, nullptr);
-                }
-                commandBuffer.drawIndexed(_primitive->indexCount, 1, _primitive->firstIndex, 0, 0);
-            }
+    PL_PROFILE_ZONE("Engine::uploadUniformBuffers");
+    auto& frame = uniformBuffers_[currentFrame_];
+
+    // the light assignment and the fragment shader share the tiles of the extent this frame
+    // renders at, a resize or a new render scale may have moved them
+    updateClusterParams();
+    memoryHelper_->uploadToBufferDirect(frame.buffer, &ubo_);
+
+    // static scenes write each frame's copy once
+    if (frame.transformVersion != transformVersion_) {
+        memoryHelper_->uploadToBufferDirect(frame.transformBuffer, transforms_.data());
+        frame.transformVersion = transformVersion_;
+    }
+    if (ubo_.lightParams.x > 0 && frame.lightVersion != clusters_.transformVersion) {
+        memoryHelper_->uploadToBufferDirect(frame.lightBuffer, clusters_.lights.data());
+        frame.lightVersion = clusters_.transformVersion;
+    }
+}
+
+void Engine::updateClusterParams()
+{
+    // tiles cover the rendered part of the scene image, slices are log spaced out to the far plane
+    float sliceScale = (float)sClusterGridZ_ / std::log(camera_.zfar / sClusterNear_);
+    glm::vec4 clusterParams(
+        (float)((renderExtent_.width + sClusterGridX_ - 1) / sClusterGridX_),
+        (float)((renderExtent_.height + sClusterGridY_ - 1) / sClusterGridY_),
+        sliceScale,
+        -std::log(sClusterNear_) * sliceScale);
+    ubo_.clusterParams = clusterParams;
+}
+
+void Engine::updateTransforms()
+{
+    PL_PROFILE_ZONE("Engine::updateTransforms");
+    if (transformVersion_ == model_->transformVersion)
+        return;
+
+    // normal matrices once per instance instead of once per vertex
+    for (size_t i = 0; i < model_->instances.size(); i++) {
+        const auto& _instance = model_->instances[i];
+        auto& transform = transforms_[i];
+
+        transform.model = _instance.node->globalMatrix;
+        transform.normal = glm::mat4(glm::transpose(glm::inverse(glm::mat3(transform.model))));
+        transform.material = _instance.primitive->material->index;
+        transform.alphaCutoff = _instance.primitive->material->alphaCutoff;
+    }
+    transformVersion_ = model_->transformVersion;
+}
+
+void Engine::updateLights()
+{
+    PL_PROFILE_ZONE("Engine::updateLights");
+    // lights are placed by their nodes
+    if (clusters_.transformVersion == model_->transformVersion)
+        return;
+
+    const auto& lights = model_->defaultScene->lights;
+    for (size_t i = 0; i < lights.size(); i++) {
+        const auto& _light = lights[i];
+        auto& light = clusters_.lights[i];
+        const glm::mat4& matrix = _light.node->globalMatrix;
+
+        // unbounded lights end where the inverse square falloff drops below the cutoff
+        glm::vec3 color = _light.color * _light.intensity;
+        float range = _light.range > 0.0f ? _light.range : std::sqrt(std::max({ color.r, color.g, color.b }) / sLightCutoff_);
+        // squared falloff from the inner to the outer cone
+        float coneScale = 0.0f;
+        float coneOffset = 1.0f;
+        if (_light.type == LightType::Spot) {
+            float outerCos = std::cos(_light.outerConeAngle);
+            coneScale = 1.0f / std::max(std::cos(_light.innerConeAngle) - outerCos, 0.001f);
+            coneOffset = -outerCos * coneScale;
         }
+
+        light.position = glm::vec4(glm::vec3(matrix[3]), range);
+        light.color = glm::vec4(color, coneScale);
+        light.direction = glm::vec4(glm::normalize(glm::mat3(matrix) * glm::vec3(0.0f, 0.0f, -1.0f)), coneOffset);
+    }
+    clusters_.transformVersion = model_->transformVersion;
+}
+
+void Engine::updateShadowCache()
+{
+    PL_PROFILE_ZONE("Engine::updateShadowCache");
+    // without an overlay layer a moved dynamic caster redraws the whole map
+    bool isMoved = model_->transformVersion != shadowCache_.transformVersion;
+    bool isAllStale = model_->staticTransformVersion != shadowCache_.staticTransformVersion
+        || shadowPass_.width != shadowCache_.resolution
+        || (isMoved && !shadowPass_.staticImage);
+
+    // a cascade is only redrawn when its own matrix moved
+    shadowCache_.staleLayers = 0;
+    for (uint32_t i = 0; i < ShadowCascades::sCount; i++) {
+        if (isAllStale || shadowCascades_.viewProj[i] != shadowCache_.cascadeViewProj[i])
+            shadowCache_.staleLayers |= 1u << (isShadowMultiview_ ? 0 : i);
     }
-    for (const auto& _node : node->children) {
-        drawNode(commandBuffer, _node);
+    shadowCache_.isStale = shadowCache_.staleLayers != 0;
+    shadowCache_.isOverlayStale = shadowCache_.isStale || isMoved;
+
+    shadowCache_.cascadeViewProj = shadowCascades_.viewProj;
+    shadowCache_.staticTransformVersion = model_->staticTransformVersion;
+    shadowCache_.transformVersion = model_->transformVersion;
+    shadowCache_.resolution = shadowPass_.width;
+}
+
+void Engine::cullInstances()
+{
+    PL_PROFILE_ZONE("Engine::cullInstances");
+    // the linear kernel wins on small scenes, the hierarchy on large ones
+    auto cull = [&](const glm::mat4& viewProj, std::vector<uint8_t>& visibility) {
+        auto frustum = extractFrustum(viewProj);
+        if (model_->instances.size() >= sBvhCullThreshold_)
+            return model_->bvh.cullFrustum(frustum, model_->instanceBounds, visibility);
+        return cullBounds(frustum, model_->instanceBounds, visibility);
+    };
+
+    // multiview draws every cascade at once, casters are culled against their union
+    if (isShadowPass_ && shadowCache_.isOverlayStale) {
+        shadowVisibility_.resize(shadowPass_.frameBuffers.size());
+        shadowCullStats_ = {};
+        for (uint32_t i = 0; i < shadowVisibility_.size(); i++) {
+            const glm::mat4& viewProj = isShadowMultiview_ ? shadowCascades_.casterViewProj : shadowCascades_.viewProj[i];
+            CullStats stats = cull(viewProj, shadowVisibility_[i]);
+            shadowCullStats_.visible += stats.visible;
+            shadowCullStats_.culled += stats.culled;
+        }
     }
+    if (COLOR_PASS)
+        colorCullStats_ = cull(camera_.proj * camera_.view, colorVisibility_);
+}
+
+void Engine::pickInstance(int x, int y)
+{
+    glm::vec2 ndc { 2.0f * x / extent_.width - 1.0f, 1.0f - 2.0f * y / extent_.height };
+    glm::mat4 invViewProj = glm::inverse(camera_.proj * camera_.view);
+
+    // reverse z, the near plane is at depth 1
+    glm::vec4 nearPoint = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    uint32_t instance;
+    float t;
+    pickedInstance_ = model_->bvh.raycast(origin, direction, model_->instanceBounds, instance, t) ? instance : -1;
 }
 
-void Engine::drawNodeShadow(vk::CommandBuffer& commandBuffer, pl::Node* node)
+void Engine::buildDrawCalls()
 {
-    if (node->mesh != nullptr && !node->mesh->primitives.empty()) {
-        pushConstants_.meshTransform = node->globalMatrix;
-        pushConstants_.useNormalTexture = 0.0f;
-        for (const auto& _primitive : node->mesh->primitives) {
-            if (_primitive->indexCount > 0) {
-                commandBuffer.pushConstants(*shadowPass_.pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants), &pushConstants_);
-                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *shadowPass_.pipelineLayout, 0, 1, &uniformBuffers_[currentFrame_].descriptorSet.get(), 0, nullptr);
-                commandBuffer.drawIndexed(_primitive->indexCount, 1, _primitive->firstIndex, 0, 0);
+    PL_PROFILE_ZONE("Engine::buildDrawCalls");
+    cullInstances();
+    drawCalls_.clear();
+
+    for (uint32_t i = 0; i < model_->instances.size(); i++) {
+        const auto& _instance = model_->instances[i];
+        glm::vec4 center = glm::vec4((_instance.min + _instance.max) * 0.5f, 1.0f);
+
+        if (isShadowPass_ && shadowCache_.isOverlayStale) {
+            // orthographic light, depth is already linear
+            constexpr uint32_t maxBucket = (1u << DrawKey::sDepthBits) - 1;
+            float lightDepth = std::clamp((shadowCascades_.casterViewProj * center).z, 0.0f, 1.0f);
+            uint32_t depth = static_cast<uint32_t>(lightDepth * static_cast<float>(maxBucket));
+            uint32_t pass = _instance.dynamic ? sShadowOverlayPassKey_ : sShadowPassKey_;
+            for (uint32_t layer = 0; layer < shadowVisibility_.size(); layer++) {
+                // static casters only in the cached layers that are redrawn
+                bool isLayerDrawn = _instance.dynamic || (shadowCache_.staleLayers & (1u << layer));
+                if (isLayerDrawn && shadowVisibility_[layer][i])
+                    drawCalls_.push_back({ DrawKey::make(pass, layer, 0, depth), i });
             }
         }
+        if (COLOR_PASS && colorVisibility_[i]) {
+            float viewDepth = -(camera_.view * center).z;
+            uint32_t depth = DrawKey::depthBucket(viewDepth, camera_.znear, camera_.zfar);
+            const auto* _material = _instance.primitive->material;
+            // the alpha test bit sorts masked variants after opaque ones
+            drawCalls_.push_back({ DrawKey::make(sColorPassKey_, materialVariant(*_material), _material->index, depth), i });
+        }
+    }
+
+    sortDrawCalls(drawCalls_, drawCallsScratch_);
+}
+
+uint32_t Engine::materialVariant(const Material& material) const
+{
+    // only masked materials pay for discard, the rest keep early depth testing
+    uint32_t variant = 0;
+    if (material.alphaMode != AlphaMode::Opaque)
+        variant |= sAlphaTestVariant_;
+    if (material.useNormalTexture > 0.5f)
+        variant |= sNormalMapVariant_;
+    return variant;
+}
+
+vk::Pipeline Engine::colorPipeline(bool depthOnly, uint32_t variant)
+{
+    if (depthOnly)
+        return *texturePipeline_.prepassPipelines[(variant & sAlphaTestVariant_) ? 1 : 0];
+    uint32_t filter = static_cast<uint32_t>(shadowFilter_);
+    if (isDepthPrepass_)
+        return *texturePipeline_.equalPipelines[filter][variant];
+    return *texturePipeline_.pipelines[filter][variant];
+}
+
+void Engine::drawScene(CommandEncoder& encoder, uint32_t pass, bool depthOnly, uint32_t cascade)
+{
+    bool shadow = pass == sShadowPassKey_ || pass == sShadowOverlayPassKey_;
+    vk::PipelineLayout layout = shadow ? *shadowPass_.pipelineLayout : *texturePipeline_.layout;
+
+    encoder.bindDescriptorSet(layout, 0, *uniformBuffers_[currentFrame_].descriptorSet);
+    if (shadow) {
+        encoder.bindPipeline(*shadowPass_.pipeline);
+        PushConstants shadowConstants { .cascade = cascade };
+        encoder.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, sizeof(PushConstants), &shadowConstants);
+    }
+
+    // transforms are indexed by instance, passed through firstInstance
+    for (const auto& _drawCall : drawCalls_) {
+        uint32_t drawPass = DrawKey::pass(_drawCall.key);
+        if (drawPass < pass)
+            continue;
+        if (drawPass > pass)
+            break;
+        // shadow draws keep their cascade layer in the pipeline field, color draws their variant
+        if (shadow && DrawKey::pipeline(_drawCall.key) != cascade)
+            continue;
+
+        const auto& _instance = model_->instances[_drawCall.instance];
+
+        if (!shadow) {
+            encoder.bindPipeline(colorPipeline(depthOnly, DrawKey::pipeline(_drawCall.key)));
+            encoder.bindDescriptorSet(layout, 1, *_instance.primitive->material->descriptorSet);
+        }
+        encoder.drawIndexed(_instance.primitive->indexCount, _instance.primitive->firstIndex, _drawCall.instance);
+    }
+}
+
+void Engine::updateGpuInstances(vk::CommandBuffer& commandBuffer)
+{
+    PL_PROFILE_ZONE("Engine::updateGpuInstances");
+    auto& frame = gpuDriven_.frames[currentFrame_];
+    for (size_t i = 0; i < model_->instances.size(); i++) {
+        gpuDriven_.instances[i].boundsMin = glm::vec4(model_->instances[i].min, 1.0f);
+        gpuDriven_.instances[i].boundsMax = glm::vec4(model_->instances[i].max, 1.0f);
+    }
+    memoryHelper_->uploadToBufferDirect(frame.instanceStaging, gpuDriven_.instances.data());
+
+    // the instance buffer is shared, the copy waits for culls of earlier frames still reading it
+    vk::BufferMemoryBarrier copyBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eShaderRead,
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = gpuDriven_.instanceBuffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, {}, copyBarrier, {});
+
+    vk::BufferCopy copy { .srcOffset = 0, .dstOffset = 0, .size = gpuDriven_.instanceBuffer->size };
+    commandBuffer.copyBuffer(frame.instanceStaging->buffer, gpuDriven_.instanceBuffer->buffer, copy);
+
+    vk::BufferMemoryBarrier cullBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = gpuDriven_.instanceBuffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, cullBarrier, {});
+    gpuDriven_.transformVersion = model_->transformVersion;
+}
+
+void Engine::cullInstancesGpu(vk::CommandBuffer& commandBuffer)
+{
+    auto& frame = gpuDriven_.frames[currentFrame_];
+
+    if (gpuDriven_.transformVersion != model_->transformVersion)
+        updateGpuInstances(commandBuffer);
+
+    commandBuffer.fillBuffer(frame.countBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+
+    vk::BufferMemoryBarrier resetBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = frame.countBuffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, resetBarrier, {});
+
+    // visibility is shared between frames, the previous late pass must land first
+    if (isOcclusionCulling_) {
+        vk::BufferMemoryBarrier visibilityBarrier {
+            .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = occlusion_.visibilityBuffer->buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE
+        };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, visibilityBarrier, {});
+    }
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *gpuDriven_.cullPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *gpuDriven_.pipelineLayout, 0, 1, &frame.descriptorSet.get(), 0, nullptr);
+
+    CullPushConstants cullConstants {
+        .instanceCount = gpuDriven_.instanceCount,
+        .batchCount = static_cast<uint32_t>(gpuDriven_.batches.size()),
+        .occlusion = isOcclusionCulling_ ? 1u : 0u,
+        .pyramidSize = glm::vec2(occlusion_.width, occlusion_.height)
+    };
+    uint32_t groupCount = (gpuDriven_.instanceCount + 63) / 64;
+
+    if (isShadowPass_ && shadowCache_.isStale) {
+        auto frustum = extractFrustum(shadowCascades_.casterViewProj);
+        std::copy(frustum.planes.begin(), frustum.planes.end(), cullConstants.planes);
+        cullConstants.pass = sShadowPassKey_;
+        commandBuffer.pushConstants(*gpuDriven_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &cullConstants);
+        commandBuffer.dispatch(groupCount, 1, 1);
+    }
+    if (COLOR_PASS) {
+        auto frustum = extractFrustum(camera_.proj * camera_.view);
+        std::copy(frustum.planes.begin(), frustum.planes.end(), cullConstants.planes);
+        cullConstants.pass = sColorPassKey_;
+        commandBuffer.pushConstants(*gpuDriven_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &cullConstants);
+        commandBuffer.dispatch(groupCount, 1, 1);
+    }
+
+    vk::BufferMemoryBarrier indirectBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    std::array<vk::BufferMemoryBarrier, 2> indirectBarriers { indirectBarrier, indirectBarrier };
+    indirectBarriers[0].buffer = frame.drawBuffer->buffer;
+    indirectBarriers[1].buffer = frame.countBuffer->buffer;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, {}, indirectBarriers, {});
+}
+
+void Engine::drawSceneIndirect(CommandEncoder& encoder, uint32_t pass, bool depthOnly, uint32_t cascade)
+{
+    const auto& frame = gpuDriven_.frames[currentFrame_];
+    constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+    if (pass == sShadowPassKey_) {
+        encoder.bindPipeline(*shadowPass_.pipeline);
+        encoder.bindDescriptorSet(*shadowPass_.pipelineLayout, 0, *uniformBuffers_[currentFrame_].descriptorSet);
+        PushConstants shadowConstants { .cascade = cascade };
+        encoder.pushConstants(*shadowPass_.pipelineLayout, vk::ShaderStageFlagBits::eVertex, sizeof(PushConstants), &shadowConstants);
+        encoder.drawIndexedIndirectCount(frame.drawBuffer->buffer, 0, frame.countBuffer->buffer, 0, gpuDriven_.instanceCount, stride);
+        return;
+    }
+
+    encoder.bindDescriptorSet(*texturePipeline_.layout, 0, *uniformBuffers_[currentFrame_].descriptorSet);
+
+    // each color phase has its own draw region and batch counts
+    uint32_t batchCount = static_cast<uint32_t>(gpuDriven_.batches.size());
+    uint32_t drawBase = pass * gpuDriven_.instanceCount;
+    uint32_t countBase = 1 + (pass - sColorPassKey_) * batchCount;
+
+    for (uint32_t i : gpuDriven_.batchOrder) {
+        const auto& _batch = gpuDriven_.batches[i];
+        if (_batch.maxDraws == 0)
+            continue;
+
+        encoder.bindPipeline(colorPipeline(depthOnly, materialVariant(*_batch.material)));
+        encoder.bindDescriptorSet(*texturePipeline_.layout, 1, *_batch.material->descriptorSet);
+        encoder.drawIndexedIndirectCount(frame.drawBuffer->buffer, (drawBase + _batch.firstDraw) * stride,
+            frame.countBuffer->buffer, (countBase + i) * sizeof(uint32_t), _batch.maxDraws, stride);
+    }
+}
+
+void Engine::drawColorPass(CommandEncoder& encoder, uint32_t pass)
+{
+    PL_PROFILE_ZONE("Engine::drawColorPass");
+    // lay down depth first so the color pass shades each pixel once
+    if (isDepthPrepass_) {
+        if (isGpuDriven_)
+            drawSceneIndirect(encoder, pass, true);
+        else
+            drawScene(encoder, pass, true);
+    }
+
+    if (isGpuDriven_)
+        drawSceneIndirect(encoder, pass);
+    else
+        drawScene(encoder, pass);
+}
+
+void Engine::beginShadowPass(vk::CommandBuffer& commandBuffer, vk::RenderPass renderPass, vk::Framebuffer framebuffer)
+{
+    // the light uses standard depth, unlike the reverse z camera
+    vk::ClearValue clearDepthValue { .depthStencil = vk::ClearDepthStencilValue { 1.0f } };
+
+    vk::RenderPassBeginInfo renderPassInfo {
+        .renderPass = renderPass,
+        .framebuffer = framebuffer,
+        .renderArea = {
+            .offset = { 0, 0 },
+            .extent = { shadowPass_.width, shadowPass_.height },
+        },
+        .clearValueCount = 1,
+        .pClearValues = &clearDepthValue
+    };
+
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+    vk::Viewport viewport {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(shadowPass_.width),
+        .height = static_cast<float>(shadowPass_.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    commandBuffer.setViewport(0, 1, &viewport);
+
+    vk::Rect2D scissor {
+        .offset = { 0, 0 },
+        .extent = { shadowPass_.width, shadowPass_.height }
+    };
+    commandBuffer.setScissor(0, 1, &scissor);
+    commandBuffer.setDepthBias(1.25f, 0.0f, 1.75f);
+    commandBuffer.bindVertexBuffers(0, vk::Buffer(model_->vertexBuffer->buffer), { 0 });
+    commandBuffer.bindIndexBuffer(vk::Buffer(model_->indexBuffer->buffer), 0, vk::IndexType::eUint32);
+}
+
+void Engine::drawShadowPass(CommandEncoder& encoder)
+{
+    PL_PROFILE_ZONE("Engine::drawShadowPass");
+    auto commandBuffer = encoder.commandBuffer();
+
+    // single layer, cascades are left untouched while their cache holds
+    if (!shadowPass_.staticImage) {
+        for (uint32_t i = 0; i < shadowPass_.frameBuffers.size(); i++) {
+            if (!(shadowCache_.staleLayers & (1u << i)))
+                continue;
+            beginShadowPass(commandBuffer, *shadowPass_.renderPass, *shadowPass_.frameBuffers[i]);
+            if (isGpuDriven_)
+                drawSceneIndirect(encoder, sShadowPassKey_, false, i);
+            else
+                drawScene(encoder, sShadowPassKey_, false, i);
+            commandBuffer.endRenderPass();
+        }
+        return;
+    }
+
+    // the copy and overlay are kept too while no caster moved
+    if (!shadowCache_.isOverlayStale)
+        return;
+
+    for (uint32_t i = 0; i < shadowPass_.staticFrameBuffers.size(); i++) {
+        if (!(shadowCache_.staleLayers & (1u << i)))
+            continue;
+        beginShadowPass(commandBuffer, *shadowPass_.staticRenderPass, *shadowPass_.staticFrameBuffers[i]);
+        drawScene(encoder, sShadowPassKey_, false, i);
+        commandBuffer.endRenderPass();
     }
-    for (const auto& _node : node->children) {
-        drawNodeShadow(commandBuffer, _node);
+
+    // copy the static layer, then draw the dynamic casters over it
+    vk::ImageSubresourceRange depthRange {
+        .aspectMask = vk::ImageAspectFlagBits::eDepth,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = ShadowCascades::sCount
+    };
+    vk::ImageMemoryBarrier copyBarrier {
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferDstOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = shadowPass_.depthImage->image,
+        .subresourceRange = depthRange
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, copyBarrier);
+
+    vk::ImageSubresourceLayers depthLayers {
+        .aspectMask = vk::ImageAspectFlagBits::eDepth,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = ShadowCascades::sCount
+    };
+    vk::ImageCopy copyRegion {
+        .srcSubresource = depthLayers,
+        .dstSubresource = depthLayers,
+        .extent = { shadowPass_.width, shadowPass_.height, 1 }
+    };
+    commandBuffer.copyImage(shadowPass_.staticImage->image, vk::ImageLayout::eTransferSrcOptimal, shadowPass_.depthImage->image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+
+    for (uint32_t i = 0; i < shadowPass_.frameBuffers.size(); i++) {
+        beginShadowPass(commandBuffer, *shadowPass_.overlayRenderPass, *shadowPass_.frameBuffers[i]);
+        drawScene(encoder, sShadowOverlayPassKey_, false, i);
+        commandBuffer.endRenderPass();
     }
 }
 
+void Engine::buildDepthPyramid(vk::CommandBuffer& commandBuffer)
+{
+    vk::ImageMemoryBarrier pyramidBarrier {
+        .srcAccessMask = occlusion_.isPyramidUndefined ? vk::AccessFlags {} : vk::AccessFlagBits::eShaderRead,
+        .dstAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .oldLayout = occlusion_.isPyramidUndefined ? vk::ImageLayout::eUndefined : vk::ImageLayout::eGeneral,
+        .newLayout = vk::ImageLayout::eGeneral,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = occlusion_.pyramid->image,
+        .subresourceRange {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = occlusion_.mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = 1 }
+    };
+    // the previous frame's late cull may still sample the pyramid
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, pyramidBarrier);
+    occlusion_.isPyramidUndefined = false;
+
+    pyramidBarrier.oldLayout = vk::ImageLayout::eGeneral;
+    pyramidBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    pyramidBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    pyramidBarrier.subresourceRange.levelCount = 1;
+
+    ReducePushConstants reduceConstants {
+        .sourceSize = glm::ivec2(renderExtent_.width, renderExtent_.height)
+    };
+
+    // a single sampled depth buffer is reduced like any other level
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, msaaSamples_ == vk::SampleCountFlagBits::e1 ? *occlusion_.reducePipeline : *occlusion_.initPipeline);
+    for (uint32_t i = 0; i < occlusion_.mipLevels; i++) {
+        if (i == 1)
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *occlusion_.reducePipeline);
+
+        reduceConstants.targetSize = glm::ivec2(std::max(occlusion_.width >> i, 1u), std::max(occlusion_.height >> i, 1u));
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *occlusion_.pipelineLayout, 0, 1, &occlusion_.descriptorSets[i].get(), 0, nullptr);
+        commandBuffer.pushConstants(*occlusion_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(ReducePushConstants), &reduceConstants);
+        commandBuffer.dispatch((reduceConstants.targetSize.x + 7) / 8, (reduceConstants.targetSize.y + 7) / 8, 1);
+
+        pyramidBarrier.subresourceRange.baseMipLevel = i;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, pyramidBarrier);
+        reduceConstants.sourceSize = reduceConstants.targetSize;
+    }
+}
+
+void Engine::assignLights(vk::CommandBuffer& commandBuffer)
+{
+    const auto& frame = uniformBuffers_[currentFrame_];
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *clusters_.pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *clusters_.pipelineLayout, 0, 1, &clusters_.descriptorSets[currentFrame_].get(), 0, nullptr);
+
+    ClusterPushConstants clusterConstants {
+        .view = camera_.view,
+        .projScale = glm::vec2(camera_.proj[0][0], camera_.proj[1][1]),
+        .depthRange = glm::vec2(camera_.znear, camera_.zfar),
+        .tileSize = glm::vec2(ubo_.clusterParams),
+        .renderSize = glm::vec2(renderExtent_.width, renderExtent_.height),
+        .sliceScale = ubo_.clusterParams.z,
+        .sliceBias = ubo_.clusterParams.w,
+        .lightCount = ubo_.lightParams.x
+    };
+    commandBuffer.pushConstants(*clusters_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(ClusterPushConstants), &clusterConstants);
+    commandBuffer.dispatch((sClusterCount_ + 63) / 64, 1, 1);
+
+    vk::BufferMemoryBarrier clusterBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = frame.clusterBuffer->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, clusterBarrier, {});
+}
+
+void Engine::drawUpscale(vk::CommandBuffer& commandBuffer, uint32_t imageIndex)
+{
+    // the previous frame's copy has read the target, every pixel of it is written again
+    vk::ImageMemoryBarrier targetBarrier {
+        .dstAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eGeneral,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = upscale_.targetImage->image,
+        .subresourceRange {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1 }
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, targetBarrier);
+
+    UpscalePushConstants upscaleConstants {
+        .sourceSize = glm::ivec2(renderExtent_.width, renderExtent_.height),
+        .targetSize = glm::ivec2(extent_.width, extent_.height)
+    };
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, antiAliasing_ == AntiAliasing::Post ? *upscale_.postAaPipeline : *upscale_.pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *upscale_.pipelineLayout, 0, 1, &upscale_.descriptorSet.get(), 0, nullptr);
+    commandBuffer.pushConstants(*upscale_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(UpscalePushConstants), &upscaleConstants);
+    commandBuffer.dispatch((extent_.width + 7) / 8, (extent_.height + 7) / 8, 1);
+
+    // the swapchain image comes in undefined, its acquire semaphore is waited on at the transfer stage
+    vk::ImageMemoryBarrier swapchainBarrier = targetBarrier;
+    swapchainBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+    swapchainBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+    swapchainBarrier.image = swapchainImages_[imageIndex];
+    targetBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    targetBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    targetBarrier.oldLayout = vk::ImageLayout::eGeneral;
+    std::array<vk::ImageMemoryBarrier, 2> copyBarriers { targetBarrier, swapchainBarrier };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, copyBarriers);
+
+    vk::ImageCopy copy {
+        .srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+        .dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+        .extent = extent_
+    };
+    commandBuffer.copyImage(upscale_.targetImage->image, vk::ImageLayout::eGeneral, swapchainImages_[imageIndex], vk::ImageLayout::eTransferDstOptimal, copy);
+
+    // headless frames have no ImGui pass to move them on, leave them ready to be copied out
+    if (isHeadless_) {
+        swapchainBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        swapchainBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        swapchainBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        swapchainBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, swapchainBarrier);
+    }
+}
+
+void Engine::cullInstancesLate(vk::CommandBuffer& commandBuffer)
+{
+    auto& frame = gpuDriven_.frames[currentFrame_];
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *gpuDriven_.cullPipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *gpuDriven_.pipelineLayout, 0, 1, &frame.descriptorSet.get(), 0, nullptr);
+
+    CullPushConstants cullConstants {
+        .instanceCount = gpuDriven_.instanceCount,
+        .batchCount = static_cast<uint32_t>(gpuDriven_.batches.size()),
+        .pass = sColorLatePassKey_,
+        .occlusion = 1,
+        .pyramidSize = glm::vec2(occlusion_.width, occlusion_.height)
+    };
+    auto frustum = extractFrustum(camera_.proj * camera_.view);
+    std::copy(frustum.planes.begin(), frustum.planes.end(), cullConstants.planes);
+    commandBuffer.pushConstants(*gpuDriven_.pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &cullConstants);
+    commandBuffer.dispatch((gpuDriven_.instanceCount + 63) / 64, 1, 1);
+
+    vk::BufferMemoryBarrier indirectBarrier {
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    std::array<vk::BufferMemoryBarrier, 2> indirectBarriers { indirectBarrier, indirectBarrier };
+    indirectBarriers[0].buffer = frame.drawBuffer->buffer;
+    indirectBarriers[1].buffer = frame.countBuffer->buffer;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, {}, indirectBarriers, {});
+}
+
+void Engine::beginColorPass(vk::CommandBuffer& commandBuffer, vk::RenderPass renderPass, uint32_t imageIndex)
+{
+    vk::ClearValue clearColor { .color = { std::array<float, 4> { 0.0f, 0.0f, 0.0f, 0.0f } } };
+    vk::ClearValue clearDepthValue { .depthStencil = vk::ClearDepthStencilValue { 0.0f } };
+    std::array<vk::ClearValue, 2> clearValues { clearColor, clearDepthValue };
+
+    vk::RenderPassBeginInfo renderPassInfo {
+        .renderPass = renderPass,
+        .framebuffer = isSceneOffscreen_ ? *upscale_.sceneFramebuffer : *swapchainFramebuffers_[imageIndex],
+        .renderArea = {
+            .offset = { 0, 0 },
+            .extent = { renderExtent_.width, renderExtent_.height } },
+        .clearValueCount = static_cast<uint32_t>(clearValues.size()),
+        .pClearValues = clearValues.data()
+    };
+
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+    vk::Viewport viewport {
+        .x = 0.0f,
+        .y = (float)renderExtent_.height,
+        .width = static_cast<float>(renderExtent_.width),
+        .height = -static_cast<float>(renderExtent_.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    commandBuffer.setViewport(0, 1, &viewport);
+
+    vk::Rect2D scissor {
+        .offset = { 0, 0 },
+        .extent = { renderExtent_.width, renderExtent_.height }
+    };
+    commandBuffer.setScissor(0, 1, &scissor);
+
+    commandBuffer.bindVertexBuffers(0, vk::Buffer(model_->vertexBuffer->buffer), { 0 });
+    commandBuffer.bindIndexBuffer(vk::Buffer(model_->indexBuffer->buffer), 0, vk::IndexType::eUint32);
+}
+
 void Engine::drawFrame()
 {
+    PL_PROFILE_ZONE("Engine::drawFrame");
     auto inFlight = *inFlightFences_[currentFrame_];
     auto imageAvailable = *imageAvailableSemaphores_[currentFrame_];
     auto renderFinished = *renderFinishedSemaphores_[currentFrame_];
     auto commandBuffer = *commandBuffers_[currentFrame_];
 
-    auto result = device_->waitForFences(inFlight, true, UINT64_MAX);
-
-    uint32_t imageIndex;
+    vk::Result result;
+    Uint64 waitStart = SDL_GetPerformanceCounter();
+    {
+        PL_PROFILE_ZONE("Engine::waitForFence");
+        result = device_->waitForFences(inFlight, true, UINT64_MAX);
+    }
+    Uint64 waited = SDL_GetPerformanceCounter() - waitStart;
+    releaseRetired();
+    // the previous use of this frame's buffers is done, they can be written now
+    uploadUniformBuffers();
+    if (isGpuDriven_ && gpuDriven_.frames[currentFrame_].isPyramidStale) {
+        updatePyramidDescriptor(*gpuDriven_.frames[currentFrame_].descriptorSet);
+        gpuDriven_.frames[currentFrame_].isPyramidStale = false;
+    }
 
-    try {
-        std::tie(result, imageIndex) = device_->acquireNextImageKHR(*swapchain_, UINT64_MAX, imageAvailable, VK_NULL_HANDLE);
-        if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR) {
-            imageAvailableSemaphores_[currentFrame_] = device_->createSemaphoreUnique({});
+    // headless frames own their offscreen image, the fence above already guards it
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame_);
+
+    if (!isHeadless_) {
+        PL_PROFILE_ZONE("Engine::acquire");
+        Uint64 acquireStart = SDL_GetPerformanceCounter();
+        try {
+            std::tie(result, imageIndex) = device_->acquireNextImageKHR(*swapchain_, UINT64_MAX, imageAvailable, VK_NULL_HANDLE);
+            // the image is acquired and the semaphore will signal, draw it and recreate after present
+            if (result == vk::Result::eSuboptimalKHR)
+                isResized_ = true;
+        } catch (vk::OutOfDateKHRError&) {
             recreateSwapchain();
             return;
         }
-    } catch (vk::OutOfDateKHRError&) {
-        recreateSwapchain();
-        return;
+        waited += SDL_GetPerformanceCounter() - acquireStart;
     }
+    frameWaitMs_ = (double)waited * 1000.0 / (double)SDL_GetPerformanceFrequency();
 
     device_->resetFences(inFlight);
 
@@ -1198,113 +3454,114 @@ void Engine::drawFrame()
     vk::CommandBufferBeginInfo beginInfo {};
     commandBuffer.begin(beginInfo);
 
-    vk::ClearValue clearColor { .color = { std::array<float, 4> { 0.0f, 0.0f, 0.0f, 0.0f } } };
-    vk::ClearValue clearDepthValue { .depthStencil = vk::ClearDepthStencilValue { 0.0f } };
-    std::array<vk::ClearValue, 2> clearValues { clearColor, clearDepthValue };
+    // the fence wait above means this frame slot's previous queries have landed
+    gpuProfiler_->beginFrame(commandBuffer, static_cast<uint32_t>(currentFrame_));
+
+    CommandEncoder encoder(commandBuffer);
+    updateShadowCache();
+    if (isGpuDriven_) {
+        GpuZone zone(*gpuProfiler_, commandBuffer, "cull");
+        cullInstancesGpu(commandBuffer);
+    } else {
+        buildDrawCalls();
+    }
 
     /*
         Shadow pass
     */
-    if (SHADOW_PASS) {
-        vk::RenderPassBeginInfo renderPassInfo {
-            .renderPass = *shadowPass_.renderPass,
-            .framebuffer = *shadowPass_.frameBuffer,
-            .renderArea = {
-                .offset = { 0, 0 },
-                .extent = { shadowPass_.width, shadowPass_.height },
-            },
-            .clearValueCount = 1,
-            .pClearValues = &clearDepthValue
-        };
-
-        commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-
-        vk::Viewport viewport {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(shadowPass_.width),
-            .height = static_cast<float>(shadowPass_.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
-        };
-        commandBuffer.setViewport(0, 1, &viewport);
-
-        vk::Rect2D scissor {
-            .offset = { 0, 0 },
-            .extent = { shadowPass_.width, shadowPass_.height }
-        };
-        commandBuffer.setScissor(0, 1, &scissor);
-        commandBuffer.setDepthBias(1.25f, 0.0f, 1.75f);
-        commandBuffer.bindVertexBuffers(0, vk::Buffer(model_->vertexBuffer->buffer), { 0 });
-        commandBuffer.bindIndexBuffer(vk::Buffer(model_->indexBuffer->buffer), 0, vk::IndexType::eUint32);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *shadowPass_.pipeline);
-
-        for (const auto& _node : model_->defaultScene->nodes) {
-            drawNodeShadow(commandBuffer, _node);
-        }
-
-        commandBuffer.endRenderPass();
+    if (isShadowPass_) {
+        // outside the render pass, shadows may be multiview
+        GpuZone zone(*gpuProfiler_, commandBuffer, "shadow");
+        drawShadowPass(encoder);
+        encoder.reset();
     }
 
     /*
         Color pass
     */
     if (COLOR_PASS) {
-        vk::RenderPassBeginInfo renderPassInfo {
-            .renderPass = *renderPass_,
-            .framebuffer = *swapchainFramebuffers_[imageIndex],
-            .renderArea = {
-                .offset = { 0, 0 },
-                .extent = { extent_.width, extent_.height } },
-            .clearValueCount = static_cast<uint32_t>(clearValues.size()),
-            .pClearValues = clearValues.data()
-        };
+        // outside the render pass, the cluster lists are read by the color pass fragments
+        if (ubo_.lightParams.x > 0) {
+            GpuZone zone(*gpuProfiler_, commandBuffer, "lights");
+            assignLights(commandBuffer);
+        }
 
-        commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+        uint32_t colorZone = gpuProfiler_->beginZone(commandBuffer, "color");
+        beginColorPass(commandBuffer, *renderPass_, imageIndex);
         {
-            vk::Viewport viewport {
-                .x = 0.0f,
-                .y = (float)extent_.height,
-                .width = static_cast<float>(extent_.width),
-                .height = -static_cast<float>(extent_.height),
-                .minDepth = 0.0f,
-                .maxDepth = 1.0f
-            };
-            commandBuffer.setViewport(0, 1, &viewport);
+            drawColorPass(encoder, sColorPassKey_);
 
-            vk::Rect2D scissor {
-                .offset = { 0, 0 },
-                .extent = { extent_.width, extent_.height }
-            };
-            commandBuffer.setScissor(0, 1, &scissor);
+            // second phase, test the rest against the first phase depth and draw what shows
+            if (isOcclusionCulling_) {
+                commandBuffer.endRenderPass();
+                encoder.reset();
 
-            commandBuffer.bindVertexBuffers(0, vk::Buffer(model_->vertexBuffer->buffer), { 0 });
-            commandBuffer.bindIndexBuffer(vk::Buffer(model_->indexBuffer->buffer), 0, vk::IndexType::eUint32);
-            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *texturePipeline_.pipeline);
+                buildDepthPyramid(commandBuffer);
+                cullInstancesLate(commandBuffer);
 
-            for (const auto& _node : model_->defaultScene->nodes) {
-                drawNode(commandBuffer, _node);
+                beginColorPass(commandBuffer, *occlusion_.loadRenderPass, imageIndex);
+                drawColorPass(encoder, sColorLatePassKey_);
             }
 
-            ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+            gpuProfiler_->endZone(commandBuffer, colorZone);
+
+            if (!isHeadless_ && !isSceneOffscreen_) {
+                GpuZone zone(*gpuProfiler_, commandBuffer, "imgui");
+                ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+            }
         }
         commandBuffer.endRenderPass();
+
+        // scaled frames are upscaled into the swapchain image, ImGui goes on top at full resolution
+        if (isSceneOffscreen_) {
+            {
+                GpuZone zone(*gpuProfiler_, commandBuffer, antiAliasing_ == AntiAliasing::Post ? "post aa" : "upscale");
+                drawUpscale(commandBuffer, imageIndex);
+            }
+            if (!isHeadless_) {
+                vk::RenderPassBeginInfo uiPassInfo {
+                    .renderPass = *upscale_.uiRenderPass,
+                    .framebuffer = *swapchainFramebuffers_[imageIndex],
+                    .renderArea = {
+                        .offset = { 0, 0 },
+                        .extent = { extent_.width, extent_.height } }
+                };
+                commandBuffer.beginRenderPass(uiPassInfo, vk::SubpassContents::eInline);
+                {
+                    GpuZone zone(*gpuProfiler_, commandBuffer, "imgui");
+                    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+                }
+                commandBuffer.endRenderPass();
+            }
+        }
     }
+    gpuProfiler_->endFrame(commandBuffer);
     commandBuffer.end();
+    drawStats_ = encoder.stats();
 
-    vk::PipelineStageFlags waitDstStageMask { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+    // scaled frames first touch the swapchain image with the upscale copy
+    vk::PipelineStageFlags waitDstStageMask { isSceneOffscreen_ ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eColorAttachmentOutput };
 
     vk::SubmitInfo submitInfo {
-        .waitSemaphoreCount = 1,
+        .waitSemaphoreCount = isHeadless_ ? 0u : 1u,
         .pWaitSemaphores = &imageAvailable,
         .pWaitDstStageMask = &waitDstStageMask,
         .commandBufferCount = 1,
         .pCommandBuffers = &commandBuffer,
-        .signalSemaphoreCount = 1,
+        .signalSemaphoreCount = isHeadless_ ? 0u : 1u,
         .pSignalSemaphores = &renderFinished
     };
 
-    graphicsQueue_.submit(submitInfo, inFlight);
+    {
+        PL_PROFILE_ZONE("Engine::submit");
+        graphicsQueue_.submit(submitInfo, inFlight);
+    }
+
+    if (isHeadless_) {
+        currentFrame_ = (currentFrame_ + 1) % sConcurrentFrames_;
+        frameNumber_++;
+        return;
+    }
 
     vk::PresentInfoKHR presentInfo {
         .waitSemaphoreCount = 1,
@@ -1315,6 +3572,7 @@ void Engine::drawFrame()
     };
 
     try {
+        PL_PROFILE_ZONE("Engine::present");
         result = graphicsQueue_.presentKHR(presentInfo);
         if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR || isResized_) {
             recreateSwapchain();
@@ -1326,6 +3584,7 @@ void Engine::drawFrame()
     }
 
     currentFrame_ = (currentFrame_ + 1) % sConcurrentFrames_;
+    frameNumber_++;
 }
 
 bool Engine::running()
@@ -1346,26 +3605,3 @@ void Engine::renderFrame()
 }
 
 }
-
-using namespace pl;
-
-Parser* args;
-Engine* engine;
-
-int main(const int argc, const char* argv[])
-{
-    args = new Parser(argc, argv);
-    engine = new Engine();
-
-    engine->init();
-    engine->loadGltfModel(args->gltf_path());
-    engine->run();
-
-    while (engine->running()) {
-        engine->processInput();
-        engine->updateState();
-        engine->renderFrame();
-    }
-
-    return 0;
-}
@@ -1,23 +1,77 @@
 #pragma once
 
+#include "benchmark.hpp"
 #include "camera.hpp"
+#include "culling.hpp"
+#include "draw.hpp"
+#include "frame_stats.hpp"
 #include "gltf.hpp"
+#include "gpu_profiler.hpp"
+#include "governor.hpp"
 #include "memory.hpp"
+#include "pipeline_cache.hpp"
+#include "shadow.hpp"
+#include "stress_scene.hpp"
 #include "types.hpp"
+#include <deque>
 #include <functional>
 #include <string>
 
 namespace pl {
 
+// msaa sample counts are lowered to what the device supports, post runs a single sampled
+// scene through an fxaa style compute pass
+enum class AntiAliasing : uint32_t {
+    None,
+    Msaa2,
+    Msaa4,
+    Msaa8,
+    Post
+};
+
+struct EngineCreateInfo {
+    bool enableValidation { true };
+    bool gpuDriven { false };
+    bool occlusionCulling { false };
+    bool depthPrepass { false };
+    // cascaded shadows from the sun, the map is cached while nothing it shows moves
+    bool shadows { false };
+    ShadowFilter shadowFilter { ShadowFilter::Pcf9 };
+    AntiAliasing antiAliasing { AntiAliasing::Msaa4 };
+    // scene resolution relative to the window, below 1 the scene is upscaled in compute, 0.25 to 1
+    float renderScale { 1.0f };
+    // frame time the quality governor holds by trading render scale, shadow detail and
+    // texture sharpness, 0 keeps the quality fixed
+    double governorTargetMs { 0.0 };
+    // render into offscreen images, no window, surface or swapchain
+    bool headless { false };
+    // frames to render before returning from run, 0 runs until the window is closed
+    // or a fixed count for headless and benchmark runs
+    uint32_t frameCount { 0 };
+    // fly the benchmark camera path over frameCount frames and write a report, see Benchmark
+    bool benchmark { false };
+    uint32_t warmupFrames { 100 };
+    std::string reportPath { "benchmark" };
+    double budgetMs { 0.0 };
+    // cpu profiler trace written when run returns, F10 writes it at any time
+    // (trace.json when empty), zones are only recorded when configured with -DPALACE_PROFILE=ON
+    std::string tracePath;
+};
+
 class Engine {
 
 public:
     Engine();
     ~Engine();
-    void init(bool enableValidation = true);
+    void init(const EngineCreateInfo& createInfo = {});
     void loadGltfModel(const char* path);
+    void loadStressScene(const StressSceneCreateInfo& createInfo);
 
     void run();
+    void runHeadless();
+    void runBenchmark();
+    // nonzero when a benchmark failed its budget or could not write its report
+    int exitStatus() const;
     bool running();
     void processInput();
     void updateState();
@@ -25,50 +79,152 @@ public:
 
     vk::UniqueCommandBuffer beginOneTimeCommandBuffer();
     void endOneTimeCommandBuffer(vk::CommandBuffer& commandBuffer);
+    MemoryHelper* memoryHelper() { return memoryHelper_.get(); }
 
 private:
     void createInstance();
     void createDevice();
     void createCommandBuffers();
     void createMemoryHelper();
+    void createPipelineCache();
     void createShadowPassResources();
+    void createShadowCacheResources();
+    void createSceneResources();
+    vk::UniqueRenderPass createShadowRenderPass(vk::RenderPassCreateInfo renderPassInfo);
+    std::vector<vk::UniqueFramebuffer> createShadowFramebuffers(vk::RenderPass renderPass, const std::vector<vk::UniqueImageView>& layerViews);
     void createDescriptorLayouts();
     void createRenderPass();
     void createPipelines();
     void createStorageBuffers();
+    void createTransformBuffers();
+    void createGpuDrivenResources();
+    // attachments, the offscreen scene image and the depth pyramid, everything sized by renderExtent_
+    void createSceneTargets();
     void createSwapchain(vk::SwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+    void createDepthPyramid();
+    void updatePyramidDescriptor(vk::DescriptorSet descriptorSet);
+    void createUpscaler();
+    void createUpscaleTargets(bool isAttachmentReused);
+    void createLightClusters();
+    void createLightBuffers();
     void createGpuSync();
+    void createGpuProfiler();
     void initImGui();
+    void initImGuiRenderer();
     void createDescriptorPool();
     void createDescriptorSets();
     void initCamera();
 
+    void buildUi();
+    void applyQualityLevel(const QualityLevel& level);
+    vk::SampleCountFlagBits sampleCount(AntiAliasing antiAliasing) const;
+    void applyAntiAliasing();
+    std::vector<vk::ImageView> colorPassAttachments(vk::ImageView target) const;
     void recreateSwapchain();
+    struct RetiredResources;
+    RetiredResources& retireResources();
+    void retireAttachments();
+    void releaseRetired();
     void updateUniformBuffers(float dt);
-    void drawNode(vk::CommandBuffer& commandBuffer, pl::Node* node);
-    void drawNodeShadow(vk::CommandBuffer& commandBuffer, pl::Node* node);
+    void uploadUniformBuffers();
+    void updateClusterParams();
+    void updateTransforms();
+    void updateLights();
+    void updateShadowCache();
+    void cullInstances();
+    void pickInstance(int x, int y);
+    void buildDrawCalls();
+    uint32_t materialVariant(const Material& material) const;
+    vk::Pipeline colorPipeline(bool depthOnly, uint32_t variant);
+    void drawScene(CommandEncoder& encoder, uint32_t pass, bool depthOnly = false, uint32_t cascade = 0);
+    void cullInstancesGpu(vk::CommandBuffer& commandBuffer);
+    void updateGpuInstances(vk::CommandBuffer& commandBuffer);
+    void drawSceneIndirect(CommandEncoder& encoder, uint32_t pass, bool depthOnly = false, uint32_t cascade = 0);
+    void drawColorPass(CommandEncoder& encoder, uint32_t pass);
+    void beginShadowPass(vk::CommandBuffer& commandBuffer, vk::RenderPass renderPass, vk::Framebuffer framebuffer);
+    void drawShadowPass(CommandEncoder& encoder);
+    void buildDepthPyramid(vk::CommandBuffer& commandBuffer);
+    void assignLights(vk::CommandBuffer& commandBuffer);
+    void drawUpscale(vk::CommandBuffer& commandBuffer, uint32_t imageIndex);
+    void cullInstancesLate(vk::CommandBuffer& commandBuffer);
+    void beginColorPass(vk::CommandBuffer& commandBuffer, vk::RenderPass renderPass, uint32_t imageIndex);
     void drawFrame();
 
     static constexpr int sWidth_ = 1600;
     static constexpr int sHeight_ = 900;
-    static constexpr int sShadowResolution_ = 4096;
+    static constexpr int sShadowResolution_ = 1536;
+    static constexpr float sShadowDistance_ = 200.0f;
+    static constexpr float sShadowSplitLambda_ = 0.8f;
     static constexpr uint32_t sConcurrentFrames_ = 2;
+    static constexpr uint32_t sHeadlessFrameCount_ = 600;
+    // attachments are allocated in steps of this many pixels so dragging a window edge rarely reallocates
+    static constexpr uint32_t sAttachmentGranularity_ = 128;
     static constexpr vk::Format sSwapchainFormat_ = vk::Format::eB8G8R8A8Unorm;
     static constexpr vk::Format sDepthAttachmentFormat_ = vk::Format::eD32Sfloat;
-    static constexpr vk::SampleCountFlagBits sMsaaSamples_ = vk::SampleCountFlagBits::e4;
+    static constexpr uint32_t sShadowPassKey_ = 0;
+    static constexpr uint32_t sColorPassKey_ = 1;
+    static constexpr uint32_t sColorLatePassKey_ = 2;
+    static constexpr uint32_t sShadowOverlayPassKey_ = 3;
+    static constexpr size_t sBvhCullThreshold_ = 4096;
+    // material variant bits, one specialized color pipeline per combination
+    static constexpr uint32_t sNormalMapVariant_ = 1;
+    static constexpr uint32_t sAlphaTestVariant_ = 2;
+    static constexpr uint32_t sVariantCount_ = 4;
+    // the color pipelines of every filter are built when the governor may switch them
+    static constexpr uint32_t sShadowFilterCount_ = 3;
+    // light clusters, screen tiles by log spaced depth slices, cluster_lights.comp and
+    // fragment.frag share these
+    static constexpr uint32_t sClusterGridX_ = 16;
+    static constexpr uint32_t sClusterGridY_ = 9;
+    static constexpr uint32_t sClusterGridZ_ = 24;
+    static constexpr uint32_t sClusterCount_ = sClusterGridX_ * sClusterGridY_ * sClusterGridZ_;
+    // a count then up to this many light indices per cluster, more are dropped
+    static constexpr uint32_t sMaxClusterLights_ = 127;
+    // the first slice ends here, closer fragments share it
+    static constexpr float sClusterNear_ = 1.0f;
+    // unbounded lights end where they fall below this
+    static constexpr float sLightCutoff_ = 1.0f / 64.0f;
 
     bool isValidationEnabled_;
+    bool isGpuDriven_ = false;
+    bool isOcclusionCulling_ = false;
+    bool isDepthPrepass_ = false;
+    bool isShadowPass_ = false;
+    bool isShadowMultiview_ = false;
+    bool isHeadless_ = false;
+    bool isBenchmark_ = false;
+    bool isTraceOnExit_ = false;
+    std::string tracePath_;
+    uint32_t frameCount_ = 0;
+    ShadowFilter shadowFilter_ = ShadowFilter::Pcf9;
+    // fixed at init, the scale itself can change on the fly
+    bool isRenderScaled_ = false;
+    // the scene renders into its own image and a compute pass, upscale or post aa, writes
+    // the swapchain image, with a render scale or post aa
+    bool isSceneOffscreen_ = false;
+    AntiAliasing antiAliasing_ = AntiAliasing::Msaa4;
+    vk::SampleCountFlagBits msaaSamples_ = vk::SampleCountFlagBits::e4;
+    // set by the UI, everything built for the sample count is rebuilt before the next frame
+    bool isAntiAliasingChanged_ = false;
+    float renderScale_ = 1.0f;
+    float lodBias_ = 0.0f;
     bool isInitialized_ = false;
     bool isSceneLoaded_ = false;
     bool isResized_ = false;
     bool isRunning_ = false;
 
     vk::Extent3D extent_;
+    // the scene's share of extent_, equal to it without a render scale
+    vk::Extent3D renderExtent_;
     size_t currentFrame_ = 0;
+    // frames submitted so far, retired resources wait on it
+    uint64_t frameNumber_ = 0;
+    // time drawFrame spent blocked on the fence and acquire rather than working
+    double frameWaitMs_ = 0.0;
     size_t indicesCount_ = 0;
 
     // instance
-    SDL_Window* window_;
+    SDL_Window* window_ {};
     vk::UniqueInstance instance_;
     vk::UniqueSurfaceKHR surface_;
 
@@ -88,6 +244,9 @@ private:
     // memory
     pl::UniqueMemoryHelper memoryHelper_;
 
+    // pipeline cache, saved on exit
+    pl::UniquePipelineCache pipelineCache_;
+
     // descriptors
     vk::UniqueDescriptorPool descriptorPool_;
     struct DescriptorSetLayouts {
@@ -95,31 +254,73 @@ private:
         vk::UniqueDescriptorSetLayout material;
     } descriptorLayouts_;
 
-    // shadow pass resources
+    // shadow pass resources, one array layer per cascade
+    // with multiview a single framebuffer covers every layer, otherwise there is one per layer
     struct ShadowPassResources {
+        // rendered top left corner, the images are sShadowResolution_ and it can shrink at runtime
         uint32_t width {}, height {};
-        vk::UniqueFramebuffer frameBuffer;
+        std::vector<vk::UniqueFramebuffer> frameBuffers;
         pl::VmaImage* depthImage {};
         pl::VmaBuffer* buffer {};
         vk::UniqueImageView depthView;
+        std::vector<vk::UniqueImageView> layerViews;
         vk::UniqueSampler depthSampler;
         vk::UniqueRenderPass renderPass;
         vk::UniquePipelineLayout pipelineLayout;
         vk::UniquePipeline pipeline;
+
+        // static casters, copied under the dynamic casters each frame
+        pl::VmaImage* staticImage {};
+        std::vector<vk::UniqueImageView> staticViews;
+        std::vector<vk::UniqueFramebuffer> staticFrameBuffers;
+        vk::UniqueRenderPass staticRenderPass;
+        vk::UniqueRenderPass overlayRenderPass;
     } shadowPass_;
 
+    // the static shadow layer is only redrawn when one of these changes, the dynamic
+    // casters over it when any node moved
+    struct ShadowCache {
+        std::array<glm::mat4, ShadowCascades::sCount> cascadeViewProj {};
+        uint64_t staticTransformVersion { ~0ull };
+        uint64_t transformVersion { ~0ull };
+        uint32_t resolution {};
+        // a bit per shadow framebuffer, multiview redraws all cascades through the first
+        uint32_t staleLayers {};
+        bool isStale { true };
+        bool isOverlayStale { true };
+    } shadowCache_;
+
     // renderpass
     vk::UniqueRenderPass renderPass_;
 
     // pipelines
     struct {
         vk::UniquePipelineLayout layout;
-        vk::UniquePipeline pipeline;
+        // indexed by shadow filter, then variant
+        std::array<std::array<vk::UniquePipeline, sVariantCount_>, sShadowFilterCount_> pipelines;
+        std::array<std::array<vk::UniquePipeline, sVariantCount_>, sShadowFilterCount_> equalPipelines;
+        // opaque and alpha tested
+        std::array<vk::UniquePipeline, 2> prepassPipelines;
     } texturePipeline_;
 
+    // fragment.frag specialization constants, in constant_id order
+    struct FragmentConstants {
+        uint32_t shadowFilter;
+        vk::Bool32 normalMap;
+        vk::Bool32 alphaTest;
+        vk::Bool32 shadows;
+    };
+
     // uniforms
     struct CameraUniformBuffer {
         VmaBuffer* buffer;
+        VmaBuffer* transformBuffer {};
+        // the transforms_ version the buffer holds
+        uint64_t transformVersion { ~0ull };
+        VmaBuffer* lightBuffer {};
+        // the lights version the buffer holds
+        uint64_t lightVersion { ~0ull };
+        VmaBuffer* clusterBuffer {};
         vk::UniqueDescriptorSet descriptorSet;
     };
     std::vector<CameraUniformBuffer> uniformBuffers_;
@@ -128,42 +329,236 @@ private:
     struct UniformBuffer {
         glm::mat4 cameraView { 1.0f };
         glm::mat4 cameraProj { 1.0f };
-        glm::mat4 lightView { 1.0f };
-        glm::mat4 lightProj { 1.0f };
+        glm::mat4 cascadeViewProj[ShadowCascades::sCount] {};
+        glm::vec4 cascadeSplits {};
         glm::vec4 lightPos { -50.0f, 50.0f, 50.0f, 1.0f };
+        // x share of the shadow map rendered, y texture lod bias
+        glm::vec4 qualityParams { 1.0f, 0.0f, 0.0f, 0.0f };
+        // x y pixels per cluster tile, z w log depth to slice scale and bias
+        glm::vec4 clusterParams {};
+        // x point and spot lights
+        glm::uvec4 lightParams {};
     } ubo_;
 
-    // push constants
+    // per instance, draws index it with firstInstance
+    struct DrawTransform {
+        glm::mat4 model;
+        glm::mat4 normal;
+        uint32_t material;
+        float alphaCutoff;
+        uint32_t pad[2];
+    };
+    std::vector<DrawTransform> transforms_;
+    // the model transform version transforms_ was filled from
+    uint64_t transformVersion_ = ~0ull;
+
+    // push constants, shadow pipelines only
     struct PushConstants {
-        glm::mat4 meshTransform;
-        float useNormalTexture;
-    } pushConstants_;
+        uint32_t cascade;
+    };
+
+    // gpu driven rendering
+    struct GpuInstance {
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t batch;
+        uint32_t drawOffset;
+    };
+
+    struct CullPushConstants {
+        glm::vec4 planes[6];
+        uint32_t instanceCount;
+        uint32_t batchCount;
+        uint32_t pass;
+        uint32_t occlusion;
+        glm::vec2 pyramidSize;
+    };
+
+    struct IndirectBatch {
+        Material* material;
+        uint32_t firstDraw;
+        uint32_t maxDraws;
+    };
+
+    struct IndirectFrame {
+        VmaBuffer* drawBuffer {};
+        VmaBuffer* countBuffer {};
+        vk::UniqueDescriptorSet descriptorSet;
+        // the pyramid was recreated, the set is rewritten once this frame is idle
+        bool isPyramidStale {};
+        // moved bounds, copied into the shared instance buffer before culling
+        VmaBuffer* instanceStaging {};
+    };
+
+    struct GpuDrivenResources {
+        uint32_t instanceCount {};
+        std::vector<GpuInstance> instances;
+        VmaBuffer* instanceBuffer {};
+        // the model transforms the instance bounds were taken from
+        uint64_t transformVersion {};
+        std::vector<IndirectBatch> batches;
+        // batch indices by variant, opaque batches first
+        std::vector<uint32_t> batchOrder;
+        std::vector<IndirectFrame> frames;
+        vk::UniqueDescriptorSetLayout descriptorLayout;
+        vk::UniquePipelineLayout pipelineLayout;
+        vk::UniquePipeline cullPipeline;
+    } gpuDriven_;
+
+    // occlusion culling, the depth pyramid is rebuilt from the first phase depth each frame
+    struct ReducePushConstants {
+        glm::ivec2 sourceSize;
+        glm::ivec2 targetSize;
+    };
+
+    struct OcclusionResources {
+        uint32_t width {}, height {}, mipLevels {};
+        pl::VmaImage* pyramid {};
+        vk::UniqueImageView pyramidView;
+        std::vector<vk::UniqueImageView> mipViews;
+        vk::UniqueSampler sampler;
+        vk::UniqueDescriptorSetLayout descriptorLayout;
+        vk::UniquePipelineLayout pipelineLayout;
+        vk::UniquePipeline initPipeline;
+        vk::UniquePipeline reducePipeline;
+        vk::UniqueDescriptorPool descriptorPool;
+        std::vector<vk::UniqueDescriptorSet> descriptorSets;
+        vk::UniqueRenderPass loadRenderPass;
+        VmaBuffer* visibilityBuffer {};
+        // the next build transitions the new pyramid out of the undefined layout
+        bool isPyramidUndefined {};
+    } occlusion_;
+
+    // clustered point and spot lights, written by the cpu each frame and assigned to the
+    // clusters they touch in compute before the color pass
+    struct GpuLight {
+        // xyz world position, w range
+        glm::vec4 position;
+        // rgb color times intensity, w spot cone scale
+        glm::vec4 color;
+        // xyz world direction, w spot cone offset, a point light has scale 0 and offset 1
+        glm::vec4 direction;
+    };
+
+    struct ClusterPushConstants {
+        glm::mat4 view;
+        glm::vec2 projScale;
+        glm::vec2 depthRange;
+        glm::vec2 tileSize;
+        glm::vec2 renderSize;
+        float sliceScale;
+        float sliceBias;
+        uint32_t lightCount;
+    };
+
+    struct LightClusterResources {
+        std::vector<GpuLight> lights;
+        // the model transform version the lights were placed from
+        uint64_t transformVersion { ~0ull };
+        vk::UniqueDescriptorSetLayout descriptorLayout;
+        vk::UniquePipelineLayout pipelineLayout;
+        vk::UniquePipeline pipeline;
+        // per frame, that frame's lights and clusters
+        std::vector<vk::UniqueDescriptorSet> descriptorSets;
+    } clusters_;
 
     // swapchain
     vk::UniqueSwapchainKHR swapchain_;
     std::vector<vk::Image> swapchainImages_;
     std::vector<vk::UniqueImageView> swapchainImageViews_;
     std::vector<vk::UniqueFramebuffer> swapchainFramebuffers_;
-    pl::VmaImage* depthImage_;
+    // headless resolve targets, one per frame in flight, stand in for the swapchain images
+    std::vector<pl::VmaImage*> offscreenImages_;
+    pl::VmaImage* depthImage_ {};
     vk::UniqueImageView depthView_;
 
-    // multisampling
-    pl::VmaImage* colorImage_;
+    // multisampling, no color image without msaa
+    pl::VmaImage* colorImage_ {};
     vk::UniqueImageView colorImageView_;
+    // size the color and depth attachments were allocated at, reused while the window fits
+    vk::Extent3D attachmentExtent_ {};
+
+    // offscreen scene, it resolves into sceneImage at renderExtent_, is upscaled or anti-aliased
+    // into targetImage at extent_ and copied to the swapchain image, ImGui is drawn over it after
+    struct UpscalePushConstants {
+        glm::ivec2 sourceSize;
+        glm::ivec2 targetSize;
+    };
+
+    struct UpscaleResources {
+        // shares the attachments' size and lifetime
+        pl::VmaImage* sceneImage {};
+        vk::UniqueImageView sceneView;
+        vk::UniqueFramebuffer sceneFramebuffer;
+        pl::VmaImage* targetImage {};
+        vk::UniqueImageView targetView;
+        vk::Extent3D targetExtent {};
+        vk::UniqueSampler sampler;
+        vk::UniqueDescriptorSetLayout descriptorLayout;
+        vk::UniquePipelineLayout pipelineLayout;
+        vk::UniquePipeline pipeline;
+        // same interface as the upscaler, picked with post aa
+        vk::UniquePipeline postAaPipeline;
+        vk::UniqueDescriptorPool descriptorPool;
+        vk::UniqueDescriptorSet descriptorSet;
+        vk::UniqueRenderPass uiRenderPass;
+    } upscale_;
+
+    // replaced on resize while earlier frames may still use them, released once frameNumber_
+    // is sConcurrentFrames_ past frame, sets are declared after their pools to be freed first
+    struct RetiredResources {
+        uint64_t frame;
+        vk::UniqueSwapchainKHR swapchain;
+        std::vector<vk::UniqueImageView> views;
+        std::vector<vk::UniqueFramebuffer> framebuffers;
+        std::vector<vk::UniqueDescriptorPool> descriptorPools;
+        std::vector<vk::UniqueDescriptorSet> descriptorSets;
+        std::vector<pl::VmaImage*> images;
+    };
+    std::deque<RetiredResources> retired_;
 
     // sync
     std::vector<vk::UniqueSemaphore> imageAvailableSemaphores_;
     std::vector<vk::UniqueSemaphore> renderFinishedSemaphores_;
     std::vector<vk::UniqueFence> inFlightFences_;
 
+    // gpu pass times
+    pl::UniqueGpuProfiler gpuProfiler_;
+
+    // cpu frame times
+    pl::UniqueFrameStats frameStats_;
+
+    // quality levels against a frame budget, only with a governor target
+    pl::UniqueFrameGovernor governor_;
+
+    // benchmark
+    BenchmarkCreateInfo benchmarkInfo_;
+    pl::UniqueBenchmark benchmark_;
+
     // scene
     pl::UniqueGltfModel model_;
 
+    // draws
+    std::vector<DrawCall> drawCalls_;
+    std::vector<DrawCall> drawCallsScratch_;
+    EncoderStats drawStats_;
+
+    // culling
+    std::vector<uint8_t> colorVisibility_;
+    // one visibility list per shadow framebuffer
+    std::vector<std::vector<uint8_t>> shadowVisibility_;
+    CullStats colorCullStats_;
+    CullStats shadowCullStats_;
+    int64_t pickedInstance_ = -1;
+
     // imgui
     vk::UniqueDescriptorPool imguiDescriptorPool_;
 
     // camera
     Camera camera_;
+    ShadowCascades shadowCascades_ {};
 
     // time
     Uint64 ticks { 0 };
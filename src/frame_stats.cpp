@@ -0,0 +1,96 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+namespace pl {
+
+FrameStats::FrameStats(const FrameStatsCreateInfo& createInfo)
+    : windowSize_(std::max(createInfo.windowSize, 1u))
+    , stutterFactor_(createInfo.stutterFactor)
+    , summaryInterval_(createInfo.summaryInterval)
+    , lastSummary_(std::chrono::steady_clock::now())
+    , frameTimes_(windowSize_, 0.0f)
+    , isStutter_(windowSize_, 0)
+{
+    scratch_.reserve(windowSize_);
+}
+
+uint32_t FrameStats::bucket(float frameMs)
+{
+    return std::min(static_cast<uint32_t>(std::max(frameMs, 0.0f)), sHistogramBuckets - 1);
+}
+
+void FrameStats::record(double frameMs)
+{
+    // the oldest frame leaves the window
+    if (count_ == windowSize_) {
+        histogram_[bucket(frameTimes_[head_])] -= 1.0f;
+        stutters_ -= isStutter_[head_];
+    } else {
+        count_++;
+    }
+
+    // judged against the window before this frame, a long hitch doesn't raise its own bar
+    bool isStutter = median_ > 0.0 && frameMs > stutterFactor_ * median_;
+    if (isStutter) {
+        stutters_++;
+        totalStutters_++;
+        lastStutterMs_ = frameMs;
+    }
+
+    frameTimes_[head_] = static_cast<float>(frameMs);
+    isStutter_[head_] = isStutter;
+    histogram_[bucket(static_cast<float>(frameMs))] += 1.0f;
+    head_ = (head_ + 1) % windowSize_;
+
+    scratch_.assign(frameTimes_.begin(), frameTimes_.begin() + count_);
+    auto middle = scratch_.begin() + scratch_.size() / 2;
+    std::nth_element(scratch_.begin(), middle, scratch_.end());
+    median_ = *middle;
+}
+
+FrameStatsSummary FrameStats::summary() const
+{
+    FrameStatsSummary summary {};
+    if (count_ == 0)
+        return summary;
+
+    scratch_.assign(frameTimes_.begin(), frameTimes_.begin() + count_);
+    std::sort(scratch_.begin(), scratch_.end());
+    summary.min = scratch_.front();
+    summary.max = scratch_.back();
+    summary.mean = std::accumulate(scratch_.begin(), scratch_.end(), 0.0) / (double)scratch_.size();
+    summary.p50 = nearestRankPercentile(scratch_, 0.50);
+    summary.p95 = nearestRankPercentile(scratch_, 0.95);
+    summary.p99 = nearestRankPercentile(scratch_, 0.99);
+    summary.frames = count_;
+    summary.stutters = stutters_;
+    return summary;
+}
+
+bool FrameStats::isSummaryDue()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSummary_ < summaryInterval_)
+        return false;
+    lastSummary_ = now;
+    return true;
+}
+
+std::string FrameStats::summaryLine() const
+{
+    FrameStatsSummary stats = summary();
+    char line[192];
+    snprintf(line, sizeof(line), "frame ms min %.2f mean %.2f max %.2f, p50 %.2f p95 %.2f p99 %.2f, %u stutters in %u frames",
+        stats.min, stats.mean, stats.max, stats.p50, stats.p95, stats.p99, stats.stutters, stats.frames);
+    return line;
+}
+
+UniqueFrameStats createFrameStatsUnique(const FrameStatsCreateInfo& createInfo)
+{
+    return std::make_unique<FrameStats>(createInfo);
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pl {
+
+// nearest rank percentile of sorted values, p in 0 to 1, the live overlay and the benchmark
+// report both use it so their percentiles agree
+template <typename T>
+double nearestRankPercentile(const std::vector<T>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p * (double)sorted.size()));
+    return (double)sorted[std::clamp(rank, size_t(1), sorted.size()) - 1];
+}
+
+struct FrameStatsCreateInfo {
+    // frames the statistics cover
+    uint32_t windowSize { 600 };
+    // a frame slower than this many medians is a stutter
+    double stutterFactor { 2.0 };
+    // shortest time between console summaries
+    double summaryInterval { 5.0 };
+};
+
+struct FrameStatsSummary {
+    double min {}, max {}, mean {};
+    double p50 {}, p95 {}, p99 {};
+    uint32_t frames {};
+    uint32_t stutters {};
+};
+
+// Rolling frame time statistics over the last windowSize frames.
+class FrameStats {
+public:
+    // 1 ms buckets, the last one also counts everything slower
+    static constexpr uint32_t sHistogramBuckets = 50;
+
+    explicit FrameStats(const FrameStatsCreateInfo& createInfo);
+
+    void record(double frameMs);
+
+    // sorts the window, call it once per frame at most
+    FrameStatsSummary summary() const;
+    const std::array<float, sHistogramBuckets>& histogram() const { return histogram_; }
+    // ring of frame times, the oldest is at offset() as ImGui::PlotLines expects
+    const std::vector<float>& frameTimes() const { return frameTimes_; }
+    uint32_t offset() const { return head_; }
+    uint64_t totalStutters() const { return totalStutters_; }
+    double lastStutterMs() const { return lastStutterMs_; }
+
+    // true at most once per summaryInterval, the summary line is then ready to print
+    bool isSummaryDue();
+    std::string summaryLine() const;
+
+private:
+    static uint32_t bucket(float frameMs);
+
+    uint32_t windowSize_;
+    double stutterFactor_;
+    std::chrono::duration<double> summaryInterval_;
+    std::chrono::steady_clock::time_point lastSummary_;
+
+    std::vector<float> frameTimes_;
+    std::vector<uint8_t> isStutter_;
+    uint32_t head_ {};
+    uint32_t count_ {};
+    std::array<float, sHistogramBuckets> histogram_ {};
+    uint32_t stutters_ {};
+    uint64_t totalStutters_ {};
+    double lastStutterMs_ {};
+    // median of the window, refreshed as frames come in
+    double median_ {};
+    mutable std::vector<float> scratch_;
+};
+
+using UniqueFrameStats = std::unique_ptr<FrameStats>;
+
+UniqueFrameStats createFrameStatsUnique(const FrameStatsCreateInfo& createInfo);
+
+}
@@ -1,6 +1,7 @@
 #include "gltf.hpp"
 
 #include "log.hpp"
+#include "profiler.hpp"
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,6 +13,7 @@ namespace pl {
 
 void GltfModel::loadImages(const char* path, tinygltf::Model& model)
 {
+    PL_PROFILE_ZONE("GltfModel::loadImages");
     for (const auto& _image : model.images) {
         auto texture = std::make_shared<Texture>();
         texture->name = (fs::path(path).parent_path() / _image.uri).string();
@@ -31,11 +33,20 @@ void GltfModel::loadImages(const char* path, tinygltf::Model& model)
 
 void GltfModel::loadMaterials(tinygltf::Model& model)
 {
+    PL_PROFILE_ZONE("GltfModel::loadMaterials");
     for (const auto& _material : model.materials) {
         auto material = std::make_shared<Material>();
+        material->index = static_cast<uint32_t>(materials.size());
         materials.push_back(material);
         material->name = _material.name;
 
+        if (_material.alphaMode == "MASK") {
+            material->alphaMode = AlphaMode::Mask;
+            material->alphaCutoff = static_cast<float>(_material.alphaCutoff);
+        }
+        else if (_material.alphaMode == "BLEND")
+            material->alphaMode = AlphaMode::Blend;
+
         // base color
         if (_material.pbrMetallicRoughness.baseColorTexture.index > -1) {
             material->baseColor = textures[model.textures[_material.pbrMetallicRoughness.baseColorTexture.index].source].get();
@@ -70,8 +81,43 @@ void GltfModel::loadMaterials(tinygltf::Model& model)
     }
 }
 
+void interleaveVertices(const float* positions, const float* normals, const float* texCoords, const glm::vec4& color, size_t count, std::vector<Vertex>& vertices)
+{
+    for (size_t i = 0; i < count; i++) {
+        vertices.push_back({ glm::make_vec3(&positions[i * 3]),
+            glm::make_vec3(&normals[i * 3]),
+            color,
+            glm::make_vec2(&texCoords[i * 2]) });
+    }
+}
+
+void rebaseIndices(const unsigned char* data, size_t count, int componentType, uint32_t firstVertex, std::vector<uint32_t>& indices)
+{
+    auto readIndexBuffer = [&]<typename T>(T dummy) {
+        T* buf = new T[count];
+        memcpy(buf, data, count * sizeof(T));
+        for (size_t i = 0; i < count; i++) {
+            indices.push_back(buf[i] + firstVertex);
+        }
+        delete[] buf;
+    };
+
+    switch (componentType) {
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+        readIndexBuffer(uint32_t {});
+        break;
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+        readIndexBuffer(uint16_t {});
+        break;
+    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+        readIndexBuffer(uint8_t {});
+        break;
+    }
+}
+
 void GltfModel::loadMeshes(tinygltf::Model& model)
 {
+    PL_PROFILE_ZONE("GltfModel::loadMeshes");
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
 
@@ -101,6 +147,8 @@ void GltfModel::loadMeshes(tinygltf::Model& model)
                 max[0] = accessor.maxValues[0] > max[0] ? accessor.maxValues[0] : max[0];
                 max[1] = accessor.maxValues[1] > max[1] ? accessor.maxValues[1] : max[1];
                 max[2] = accessor.maxValues[2] > max[2] ? accessor.maxValues[2] : max[2];
+                primitive->min = glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+                primitive->max = glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
 
                 const auto& bufferView = model.bufferViews[accessor.bufferView];
                 const auto& buffer = model.buffers[bufferView.buffer];
@@ -129,12 +177,7 @@ void GltfModel::loadMeshes(tinygltf::Model& model)
             primitive->material = materials[_primitive.material].get();
 
             // vertices
-            for (size_t i = 0; i < primitive->vertexCount; i++) {
-                vertices.push_back({ glm::make_vec3(&positions[i * 3]),
-                    glm::make_vec3(&normals[i * 3]),
-                    color,
-                    glm::make_vec2(&texCoords[i * 2]) });
-            }
+            interleaveVertices(positions, normals, texCoords, color, primitive->vertexCount, vertices);
 
             // indices
             {
@@ -142,27 +185,7 @@ void GltfModel::loadMeshes(tinygltf::Model& model)
                 const auto& bufferView = model.bufferViews[accessor.bufferView];
                 const auto& buffer = model.buffers[bufferView.buffer];
                 primitive->indexCount = (uint32_t)accessor.count;
-
-                auto readIndexBuffer = [&]<typename T>(T dummy) {
-                    T* buf = new T[accessor.count];
-                    memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(T));
-                    for (size_t i = 0; i < accessor.count; i++) {
-                        indices.push_back(buf[i] + primitive->firstVertex);
-                    }
-                    delete[] buf;
-                };
-
-                switch (accessor.componentType) {
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
-                    readIndexBuffer(uint32_t {});
-                    break;
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
-                    readIndexBuffer(uint16_t {});
-                    break;
-                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
-                    readIndexBuffer(uint8_t {});
-                    break;
-                }
+                rebaseIndices(&buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count, accessor.componentType, primitive->firstVertex, indices);
             }
 
             primitives.push_back(primitive);
@@ -194,6 +217,18 @@ glm::mat4 Node::getGlobalMatrix()
     return m;
 }
 
+void GltfModel::loadAnimatedNodes(tinygltf::Model& model)
+{
+    PL_PROFILE_ZONE("GltfModel::loadAnimatedNodes");
+    animatedNodes.assign(model.nodes.size(), false);
+    for (const auto& _animation : model.animations) {
+        for (const auto& _channel : _animation.channels) {
+            if (_channel.target_node >= 0 && _channel.target_node < model.nodes.size())
+                animatedNodes[_channel.target_node] = true;
+        }
+    }
+}
+
 void GltfModel::loadNode(Scene* scene, Node* parent, tinygltf::Node& node, tinygltf::Model& model)
 {
     auto newNode = std::make_shared<Node>();
@@ -201,6 +236,7 @@ void GltfModel::loadNode(Scene* scene, Node* parent, tinygltf::Node& node, tinyg
     nodes.push_back(newNode);
     newNode->parent = parent;
     newNode->name = node.name;
+    newNode->dynamic = (parent && parent->dynamic) || animatedNodes[&node - model.nodes.data()];
 
     // Generate local node matrix
     if (node.translation.size() == 3) {
@@ -225,20 +261,82 @@ void GltfModel::loadNode(Scene* scene, Node* parent, tinygltf::Node& node, tinyg
     if (node.mesh > -1) {
         newNode->mesh = meshes[node.mesh].get();
     }
+
+    // directional lights are skipped, the shadowed sun covers them
+    if (node.light > -1) {
+        const auto& _light = model.lights[node.light];
+        if (_light.type == "point" || _light.type == "spot") {
+            Light light { newNode.get(), _light.type == "spot" ? LightType::Spot : LightType::Point };
+            if (_light.color.size() == 3)
+                light.color = glm::vec3(_light.color[0], _light.color[1], _light.color[2]);
+            light.intensity = static_cast<float>(_light.intensity);
+            light.range = static_cast<float>(_light.range);
+            light.innerConeAngle = static_cast<float>(_light.spot.innerConeAngle);
+            light.outerConeAngle = static_cast<float>(_light.spot.outerConeAngle);
+            scene->lights.push_back(light);
+        }
+    }
 }
 
-GltfModel::GltfModel(const GltfModelCreateInfo& createInfo)
-    : memoryHelper(createInfo.memory)
+void GltfModel::loadInstances(Scene* scene)
 {
-    defaultScene = nullptr;
-    vertexBuffer = nullptr;
-    indexBuffer = nullptr;
+    PL_PROFILE_ZONE("GltfModel::loadInstances");
+    // scene->nodes already holds every node of the hierarchy, children included
+    for (auto _node : scene->nodes) {
+        if (_node->mesh == nullptr)
+            continue;
+        for (auto _primitive : _node->mesh->primitives) {
+            if (_primitive->indexCount == 0)
+                continue;
+            Instance instance { _node, _primitive };
+            transformBounds(_node->globalMatrix, _primitive->min, _primitive->max, instance.min, instance.max);
+            instance.dynamic = _node->dynamic;
+            hasDynamicInstances |= instance.dynamic;
+            instances.push_back(instance);
+        }
+    }
+
+    instanceBounds.resize(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        instanceBounds.set(i, instances[i].min, instances[i].max);
+    }
+    bvh.build(instanceBounds);
+}
 
-    tinygltf::Model model;
+void GltfModel::updateTransforms()
+{
+    PL_PROFILE_ZONE("GltfModel::updateTransforms");
+    bool moved = false;
+    bool staticMoved = false;
+    for (auto& _node : nodes) {
+        glm::mat4 globalMatrix = _node->getGlobalMatrix();
+        if (globalMatrix == _node->globalMatrix)
+            continue;
+        moved = true;
+        staticMoved |= !_node->dynamic;
+        _node->globalMatrix = globalMatrix;
+    }
+    if (!moved)
+        return;
+    transformVersion++;
+    if (staticMoved)
+        staticTransformVersion++;
+
+    for (size_t i = 0; i < instances.size(); i++) {
+        auto& _instance = instances[i];
+        transformBounds(_instance.node->globalMatrix, _instance.primitive->min, _instance.primitive->max, _instance.min, _instance.max);
+        instanceBounds.set(i, _instance.min, _instance.max);
+    }
+    bvh.refit(instanceBounds);
+}
+
+bool GltfModel::parse(const char* path, tinygltf::Model& model)
+{
+    PL_PROFILE_ZONE("GltfModel::parse");
     tinygltf::TinyGLTF loader;
     std::string warn, err;
 
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, createInfo.path);
+    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, path);
 
     if (!warn.empty()) {
         pl::LOG_WARN(warn.c_str(), "GLTF");
@@ -246,13 +344,28 @@ GltfModel::GltfModel(const GltfModelCreateInfo& createInfo)
 
     if (!err.empty()) {
         pl::LOG_ERROR(err.c_str(), "GLTF");
-        return;
+        return false;
     }
 
     if (!ret) {
         pl::LOG_ERROR("Failed to parse gltf file", "GLTF");
-        return;
+        return false;
     }
+    return true;
+}
+
+GltfModel::GltfModel(const GltfModelCreateInfo& createInfo)
+    : memoryHelper(createInfo.memory)
+{
+    PL_PROFILE_ZONE("GltfModel");
+    defaultScene = nullptr;
+    vertexBuffer = nullptr;
+    indexBuffer = nullptr;
+
+    tinygltf::Model parsed;
+    if (!createInfo.model && !parse(createInfo.path, parsed))
+        return;
+    tinygltf::Model& model = createInfo.model ? *createInfo.model : parsed;
 
     // textures
     loadImages(createInfo.path, model);
@@ -262,9 +375,11 @@ GltfModel::GltfModel(const GltfModelCreateInfo& createInfo)
 
     // meshes
     loadMeshes(model);
+    loadAnimatedNodes(model);
 
     // scenes
     for (const auto& _scene : model.scenes) {
+        PL_PROFILE_ZONE("GltfModel::loadScene");
         auto scene = std::make_shared<Scene>();
         scene->name = _scene.name;
         for (int i : _scene.nodes) {
@@ -277,6 +392,9 @@ GltfModel::GltfModel(const GltfModelCreateInfo& createInfo)
     }
     defaultScene = scenes[model.defaultScene].get();
 
+    // instances
+    loadInstances(defaultScene);
+
     complete = true;
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "bvh.hpp"
+#include "culling.hpp"
 #include "memory.hpp"
 #include "tiny_gltf.h"
 #include "types.hpp"
@@ -24,8 +26,19 @@ struct Texture {
     vk::DescriptorImageInfo descriptor;
 };
 
+// blended materials are drawn alpha tested, there is no transparent pass
+enum class AlphaMode {
+    Opaque,
+    Mask,
+    Blend
+};
+
 struct Material {
     std::string name;
+    uint32_t index;
+    AlphaMode alphaMode { AlphaMode::Opaque };
+    // alpha below it is discarded, the file's cutoff for masked materials
+    float alphaCutoff { 0.5f };
     float useNormalTexture;
     Texture* baseColor;
     Texture* normal;
@@ -37,6 +50,8 @@ struct Primitive {
     uint32_t vertexCount;
     uint32_t firstIndex;
     uint32_t indexCount;
+    glm::vec3 min;
+    glm::vec3 max;
     Material* material;
 };
 
@@ -55,30 +70,73 @@ struct Node {
     glm::vec3 scale { 1.0f };
     glm::mat4 matrix { 1.0f };
     glm::mat4 globalMatrix { 1.0f };
+    // animated, or below an animated node
+    bool dynamic { false };
     glm::mat4 getLocalMatrix();
     glm::mat4 getGlobalMatrix();
 };
 
+// KHR_lights_punctual point and spot lights, the sun stays the engine's directional light
+enum class LightType {
+    Point,
+    Spot
+};
+
+// placed and aimed down -z by its node, which may be animated
+struct Light {
+    Node* node;
+    LightType type;
+    glm::vec3 color { 1.0f };
+    float intensity { 1.0f };
+    // 0 when the file leaves it unbounded
+    float range { 0.0f };
+    float innerConeAngle { 0.0f };
+    float outerConeAngle { 0.7853982f };
+};
+
 struct Scene {
     std::string name;
     std::vector<Node*> nodes;
+    std::vector<Light> lights;
+};
+
+// a primitive placed in the scene by a node, the unit of drawing
+struct Instance {
+    Node* node;
+    Primitive* primitive;
+    glm::vec3 min;
+    glm::vec3 max;
+    bool dynamic;
 };
 
 struct GltfModelCreateInfo {
+    // also the directory textures are named after
     const char* path;
     MemoryHelper* memory;
+    // already parsed or generated, loaded instead of the file at path
+    tinygltf::Model* model { nullptr };
 };
 
 class GltfModel {
 public:
     explicit GltfModel(const GltfModelCreateInfo& createInfo);
 
+    // recompute global matrices, and instance bounds when any node moved
+    void updateTransforms();
+
     std::vector<std::shared_ptr<Scene>> scenes;
     std::vector<std::shared_ptr<Mesh>> meshes;
     std::vector<std::shared_ptr<Primitive>> primitives;
     std::vector<std::shared_ptr<Texture>> textures;
     std::vector<std::shared_ptr<Material>> materials;
     std::vector<std::shared_ptr<Node>> nodes;
+    std::vector<Instance> instances;
+    BoundsSoA instanceBounds;
+    Bvh bvh;
+    // bumped whenever any node moves, and for static nodes the version shadow caches follow
+    uint64_t transformVersion { 0 };
+    uint64_t staticTransformVersion { 0 };
+    bool hasDynamicInstances { false };
     glm::vec3 min { std::numeric_limits<float>::max() };
     glm::vec3 max { std::numeric_limits<float>::min() };
 
@@ -89,13 +147,22 @@ public:
 
 private:
     MemoryHelper* memoryHelper;
+    std::vector<bool> animatedNodes;
 
+    static bool parse(const char* path, tinygltf::Model& model);
     void loadImages(const char* path, tinygltf::Model& model);
     void loadMaterials(tinygltf::Model& model);
     void loadMeshes(tinygltf::Model& model);
+    void loadAnimatedNodes(tinygltf::Model& model);
     void loadNode(Scene* scene, Node* parent, tinygltf::Node& node, tinygltf::Model& model);
+    void loadInstances(Scene* scene);
 };
 
+// loadMeshes inner loops, free functions so palace_bench can time them alone
+void interleaveVertices(const float* positions, const float* normals, const float* texCoords, const glm::vec4& color, size_t count, std::vector<Vertex>& vertices);
+// widens glTF indices of any unsigned component type and offsets them into the shared vertex buffer
+void rebaseIndices(const unsigned char* data, size_t count, int componentType, uint32_t firstVertex, std::vector<uint32_t>& indices);
+
 using UniqueGltfModel = std::unique_ptr<GltfModel>;
 
 UniqueGltfModel createGltfModelUnique(const GltfModelCreateInfo& createInfo);
@@ -0,0 +1,73 @@
+#include "governor.hpp"
+
+#include <algorithm>
+
+namespace pl {
+
+FrameGovernor::FrameGovernor(const FrameGovernorCreateInfo& createInfo)
+    : targetMs_(createInfo.targetMs)
+    , levels_(createInfo.levels)
+    , smoothing_(std::clamp(createInfo.smoothing, 0.01, 1.0))
+    , downFrames_(std::max(createInfo.downFrames, 1u))
+    , spikeFactor_(createInfo.spikeFactor)
+    , spikeFrames_(std::max(createInfo.spikeFrames, 1u))
+    , upThreshold_(createInfo.upThreshold)
+    , upFrames_(std::max(createInfo.upFrames, 1u))
+    , settleFrames_(createInfo.settleFrames)
+    , upHold_(upFrames_)
+{
+    if (levels_.empty())
+        levels_.push_back({ 1.0f, 0, ShadowFilter::Pcf9, 0.0f });
+}
+
+bool FrameGovernor::update(double cpuMs, double gpuMs)
+{
+    frame_++;
+    // the slower side sets the frame rate
+    double frameMs = std::max(cpuMs, gpuMs);
+
+    // the first frames after a change still show the old level, the average restarts after them
+    if (settle_ > 0) {
+        if (--settle_ == 0)
+            smoothedMs_ = frameMs;
+        return false;
+    }
+    smoothedMs_ = smoothedMs_ > 0.0 ? smoothedMs_ + smoothing_ * (frameMs - smoothedMs_) : frameMs;
+
+    overFrames_ = smoothedMs_ > targetMs_ ? overFrames_ + 1 : 0;
+    spikes_ = frameMs > spikeFactor_ * targetMs_ ? spikes_ + 1 : 0;
+    underFrames_ = smoothedMs_ < upThreshold_ * targetMs_ ? underFrames_ + 1 : 0;
+
+    if ((overFrames_ >= downFrames_ || spikes_ >= spikeFrames_) && level_ + 1 < levels_.size()) {
+        // back down soon after going up, the upper level doesn't fit yet
+        upHold_ = lastUpFrame_ > 0 && frame_ - lastUpFrame_ < 2ull * upHold_ ? std::min(upHold_ * 2, upFrames_ * 16) : upFrames_;
+        step(level_ + 1);
+        return true;
+    }
+
+    if (underFrames_ >= upHold_ && level_ > 0) {
+        lastUpFrame_ = frame_;
+        step(level_ - 1);
+        return true;
+    }
+
+    return false;
+}
+
+void FrameGovernor::step(uint32_t level)
+{
+    level_ = level;
+    settle_ = settleFrames_;
+    if (settle_ == 0)
+        smoothedMs_ = 0.0;
+    overFrames_ = 0;
+    spikes_ = 0;
+    underFrames_ = 0;
+}
+
+UniqueFrameGovernor createFrameGovernorUnique(const FrameGovernorCreateInfo& createInfo)
+{
+    return std::make_unique<FrameGovernor>(createInfo);
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "shadow.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pl {
+
+// one rung of the quality ladder
+struct QualityLevel {
+    float renderScale;
+    // rendered corner of the shadow map, at most its full size
+    uint32_t shadowResolution;
+    ShadowFilter shadowFilter;
+    // added to the texture mip level, positive is blurrier and reads less memory
+    float lodBias;
+};
+
+struct FrameGovernorCreateInfo {
+    // 16.6 holds 60 Hz
+    double targetMs { 16.6 };
+    // best first, each cheaper than the one before, the governor starts at the first
+    std::vector<QualityLevel> levels;
+    // weight of the newest frame in the moving average
+    double smoothing { 0.1 };
+    // steps down after the average stays over the target this many frames
+    uint32_t downFrames { 12 };
+    // or after this many frames in a row over spikeFactor targets, a sharp jump in content
+    // degrades within a few frames while single hitches never change the level
+    double spikeFactor { 1.5 };
+    uint32_t spikeFrames { 3 };
+    // steps up after the average stays under upThreshold targets this many frames
+    double upThreshold { 0.75 };
+    uint32_t upFrames { 120 };
+    // measurements ignored after a change, gpu times lag by the frames in flight
+    uint32_t settleFrames { 8 };
+};
+
+// Holds the frame time under a budget by walking a quality ladder one level at a time.
+// Stepping down is quick and stepping up slow, and a level that had to be left again soon
+// after stepping up to it waits twice as long before the next try, so a scene that sits
+// near the budget settles instead of oscillating.
+class FrameGovernor {
+public:
+    explicit FrameGovernor(const FrameGovernorCreateInfo& createInfo);
+
+    // cost of the latest frame, true when the level changed
+    bool update(double cpuMs, double gpuMs);
+
+    const QualityLevel& level() const { return levels_[level_]; }
+    uint32_t levelIndex() const { return level_; }
+    uint32_t levelCount() const { return static_cast<uint32_t>(levels_.size()); }
+    double targetMs() const { return targetMs_; }
+    double smoothedMs() const { return smoothedMs_; }
+
+private:
+    void step(uint32_t level);
+
+    double targetMs_;
+    std::vector<QualityLevel> levels_;
+    double smoothing_;
+    uint32_t downFrames_;
+    double spikeFactor_;
+    uint32_t spikeFrames_;
+    double upThreshold_;
+    uint32_t upFrames_;
+    uint32_t settleFrames_;
+
+    uint32_t level_ {};
+    double smoothedMs_ {};
+    uint64_t frame_ {};
+    uint32_t settle_ {};
+    uint32_t overFrames_ {};
+    uint32_t spikes_ {};
+    uint32_t underFrames_ {};
+    // frames an upward step waits for, doubled while steps up keep failing
+    uint32_t upHold_;
+    uint64_t lastUpFrame_ {};
+};
+
+using UniqueFrameGovernor = std::unique_ptr<FrameGovernor>;
+
+UniqueFrameGovernor createFrameGovernorUnique(const FrameGovernorCreateInfo& createInfo);
+
+}
@@ -0,0 +1,118 @@
+#include "gpu_profiler.hpp"
+
+#include "log.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace pl {
+
+GpuProfiler::GpuProfiler(const GpuProfilerCreateInfo& createInfo)
+    : device_(createInfo.device)
+{
+    vk::PhysicalDeviceProperties properties = createInfo.physicalDevice.getProperties();
+    uint32_t validBits = createInfo.physicalDevice.getQueueFamilyProperties()[createInfo.queueFamily].timestampValidBits;
+    isSupported_ = properties.limits.timestampComputeAndGraphics && validBits > 0;
+    if (!isSupported_) {
+        LOG_WARN("Timestamp queries not supported, gpu times are not measured.", "GFX");
+        return;
+    }
+    timestampPeriod_ = properties.limits.timestampPeriod;
+    timestampMask_ = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    vk::QueryPoolCreateInfo queryPoolInfo {
+        .queryType = vk::QueryType::eTimestamp,
+        .queryCount = sQueryCount
+    };
+    frames_.resize(createInfo.frameCount);
+    for (auto& _frame : frames_) {
+        _frame.pool = device_.createQueryPoolUnique(queryPoolInfo);
+        _frame.names.reserve(sMaxZones);
+    }
+}
+
+void GpuProfiler::beginFrame(vk::CommandBuffer commandBuffer, uint32_t frame)
+{
+    if (!isSupported_)
+        return;
+
+    frame_ = frame;
+    FrameQueries& queries = frames_[frame_];
+    collect(queries);
+
+    queries.names.clear();
+    queries.isWritten = false;
+    commandBuffer.resetQueryPool(*queries.pool, 0, sQueryCount);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *queries.pool, 0);
+}
+
+void GpuProfiler::endFrame(vk::CommandBuffer commandBuffer)
+{
+    if (!isSupported_)
+        return;
+
+    FrameQueries& queries = frames_[frame_];
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *queries.pool, 1);
+    queries.isWritten = true;
+}
+
+uint32_t GpuProfiler::beginZone(vk::CommandBuffer commandBuffer, const char* name)
+{
+    if (!isSupported_ || frames_[frame_].names.size() == sMaxZones)
+        return sMaxZones;
+
+    FrameQueries& queries = frames_[frame_];
+    uint32_t zone = static_cast<uint32_t>(queries.names.size());
+    queries.names.push_back(name);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *queries.pool, 2 + 2 * zone);
+    return zone;
+}
+
+void GpuProfiler::endZone(vk::CommandBuffer commandBuffer, uint32_t zone)
+{
+    if (!isSupported_ || zone >= sMaxZones)
+        return;
+
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *frames_[frame_].pool, 3 + 2 * zone);
+}
+
+void GpuProfiler::collect(FrameQueries& queries)
+{
+    if (!queries.isWritten)
+        return;
+
+    // no wait flag, a slot that is somehow not ready keeps the previous results
+    uint32_t queryCount = 2 + 2 * static_cast<uint32_t>(queries.names.size());
+    std::array<uint64_t, sQueryCount> timestamps {};
+    auto result = device_.getQueryPoolResults(*queries.pool, 0, queryCount, queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess)
+        return;
+
+    auto elapsed = [&](uint32_t query) {
+        return (double)((timestamps[query + 1] - timestamps[query]) & timestampMask_) * timestampPeriod_ * 1e-6;
+    };
+
+    frameMs_ = elapsed(0);
+    history_[historyOffset_] = static_cast<float>(frameMs_);
+    historyOffset_ = (historyOffset_ + 1) % sHistorySize;
+
+    zones_.clear();
+    for (uint32_t i = 0; i < queries.names.size(); i++) {
+        GpuZoneTime zone { queries.names[i], elapsed(2 + 2 * i) };
+        zones_.push_back(zone);
+
+        auto average = std::find_if(zoneAverages_.begin(), zoneAverages_.end(), [&](const GpuZoneTime& _average) {
+            return strcmp(_average.name, zone.name) == 0;
+        });
+        if (average == zoneAverages_.end())
+            zoneAverages_.push_back(zone);
+        else
+            average->ms += (zone.ms - average->ms) * sSmoothing;
+    }
+}
+
+UniqueGpuProfiler createGpuProfilerUnique(const GpuProfilerCreateInfo& createInfo)
+{
+    return std::make_unique<GpuProfiler>(createInfo);
+}
+
+}
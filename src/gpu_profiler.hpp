@@ -0,0 +1,102 @@
+#pragma once
+
+#include "types.hpp"
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace pl {
+
+struct GpuZoneTime {
+    // string literal passed to beginZone
+    const char* name;
+    double ms;
+};
+
+struct GpuProfilerCreateInfo {
+    vk::PhysicalDevice physicalDevice;
+    vk::Device device;
+    uint32_t queueFamily;
+    // one query pool per frame in flight
+    uint32_t frameCount;
+};
+
+// Timestamp queries around named zones of a frame.
+// A frame slot is read back when it comes around again, after its fence was waited,
+// so results lag by the frames in flight and reading them never stalls.
+class GpuProfiler {
+public:
+    static constexpr uint32_t sMaxZones = 16;
+    static constexpr uint32_t sHistorySize = 240;
+
+    explicit GpuProfiler(const GpuProfilerCreateInfo& createInfo);
+
+    bool supported() const { return isSupported_; }
+
+    // the frame's fence must be signaled, collects the slot's previous results
+    void beginFrame(vk::CommandBuffer commandBuffer, uint32_t frame);
+    void endFrame(vk::CommandBuffer commandBuffer);
+    // zones must not be opened inside a multiview render pass, timestamps there write one query per view
+    uint32_t beginZone(vk::CommandBuffer commandBuffer, const char* name);
+    void endZone(vk::CommandBuffer commandBuffer, uint32_t zone);
+
+    double frameMs() const { return frameMs_; }
+    const std::vector<GpuZoneTime>& zones() const { return zones_; }
+    // every zone seen so far, smoothed over recent frames
+    const std::vector<GpuZoneTime>& zoneAverages() const { return zoneAverages_; }
+    // ring of frame times, the oldest is at historyOffset() as ImGui::PlotLines expects
+    const std::array<float, sHistorySize>& history() const { return history_; }
+    uint32_t historyOffset() const { return historyOffset_; }
+
+private:
+    // query 0 and 1 bracket the frame, zone i uses 2 + 2i and 3 + 2i
+    static constexpr uint32_t sQueryCount = 2 + 2 * sMaxZones;
+    static constexpr double sSmoothing = 1.0 / 32.0;
+
+    struct FrameQueries {
+        vk::UniqueQueryPool pool;
+        std::vector<const char*> names;
+        bool isWritten {};
+    };
+
+    void collect(FrameQueries& queries);
+
+    vk::Device device_;
+    bool isSupported_ {};
+    double timestampPeriod_ { 1.0 };
+    uint64_t timestampMask_ { ~0ull };
+    std::vector<FrameQueries> frames_;
+    uint32_t frame_ {};
+
+    double frameMs_ {};
+    std::vector<GpuZoneTime> zones_;
+    std::vector<GpuZoneTime> zoneAverages_;
+    std::array<float, sHistorySize> history_ {};
+    uint32_t historyOffset_ {};
+};
+
+using UniqueGpuProfiler = std::unique_ptr<GpuProfiler>;
+
+UniqueGpuProfiler createGpuProfilerUnique(const GpuProfilerCreateInfo& createInfo);
+
+// closes the zone when it goes out of scope
+class GpuZone {
+public:
+    GpuZone(GpuProfiler& profiler, vk::CommandBuffer commandBuffer, const char* name)
+        : profiler_(profiler)
+        , commandBuffer_(commandBuffer)
+        , zone_(profiler.beginZone(commandBuffer, name))
+    {
+    }
+    ~GpuZone() { profiler_.endZone(commandBuffer_, zone_); }
+
+    GpuZone(const GpuZone&) = delete;
+    GpuZone& operator=(const GpuZone&) = delete;
+
+private:
+    GpuProfiler& profiler_;
+    vk::CommandBuffer commandBuffer_;
+    uint32_t zone_;
+};
+
+}
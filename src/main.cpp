@@ -0,0 +1,64 @@
+#include "engine.hpp"
+#include "parser.hpp"
+#include <cstdlib>
+
+using namespace pl;
+
+Parser* args;
+Engine* engine;
+
+int main(const int argc, const char* argv[])
+{
+    args = new Parser(argc, argv);
+    engine = new Engine();
+
+    // -shadows 1 draws the cascades, -shadowfilter 4 | 9 | poisson, -scale 0.25 to 1, -governor frame budget in ms
+    std::string shadowFilter = args->arg("-shadowfilter", "9");
+    // -aa off | 2 | 4 | 8 | post
+    std::string antiAliasing = args->arg("-aa", "4");
+    EngineCreateInfo createInfo {
+        .gpuDriven = args->flag("-gpu"),
+        .occlusionCulling = args->flag("-occlusion"),
+        .depthPrepass = args->flag("-prepass"),
+        .shadows = args->flag("-shadows"),
+        .shadowFilter = shadowFilter == "4" ? ShadowFilter::Pcf4 : shadowFilter == "poisson" ? ShadowFilter::Poisson : ShadowFilter::Pcf9,
+        .antiAliasing = antiAliasing == "off" ? AntiAliasing::None : antiAliasing == "2" ? AntiAliasing::Msaa2 : antiAliasing == "8" ? AntiAliasing::Msaa8 : antiAliasing == "post" ? AntiAliasing::Post : AntiAliasing::Msaa4,
+        .renderScale = std::strtof(args->arg("-scale", "1"), nullptr),
+        .governorTargetMs = std::strtod(args->arg("-governor", "0"), nullptr),
+        .headless = args->flag("-headless"),
+        .frameCount = static_cast<uint32_t>(std::strtoul(args->arg("-frames", "0"), nullptr, 10)),
+        .benchmark = args->flag("-benchmark"),
+        .warmupFrames = static_cast<uint32_t>(std::strtoul(args->arg("-warmup", "100"), nullptr, 10)),
+        .reportPath = args->arg("-report", "benchmark"),
+        .budgetMs = std::strtod(args->arg("-budget", "0"), nullptr),
+        .tracePath = args->arg("-trace", "")
+    };
+
+    engine->init(createInfo);
+    // -stress 1 generates a scene instead of loading one
+    if (args->flag("-stress")) {
+        StressSceneCreateInfo stressInfo {
+            .instanceCount = static_cast<uint32_t>(std::strtoul(args->arg("-instances", "10000"), nullptr, 10)),
+            .meshCount = static_cast<uint32_t>(std::strtoul(args->arg("-meshes", "64"), nullptr, 10)),
+            .materialCount = static_cast<uint32_t>(std::strtoul(args->arg("-materials", "16"), nullptr, 10)),
+            .textureSize = static_cast<uint32_t>(std::strtoul(args->arg("-texturesize", "256"), nullptr, 10)),
+            .hierarchyDepth = static_cast<uint32_t>(std::strtoul(args->arg("-depth", "1"), nullptr, 10)),
+            .density = static_cast<uint32_t>(std::strtoul(args->arg("-density", "16"), nullptr, 10)),
+            .lightCount = static_cast<uint32_t>(std::strtoul(args->arg("-lights", "0"), nullptr, 10)),
+            .seed = static_cast<uint32_t>(std::strtoul(args->arg("-seed", "1"), nullptr, 10))
+        };
+        engine->loadStressScene(stressInfo);
+    } else {
+        engine->loadGltfModel(args->gltf_path());
+    }
+    engine->run();
+    int status = engine->exitStatus();
+
+    while (engine->running()) {
+        engine->processInput();
+        engine->updateState();
+        engine->renderFrame();
+    }
+
+    return status;
+}
@@ -1,6 +1,8 @@
 #include "memory.hpp"
 
 #include "engine.hpp"
+#include "profiler.hpp"
+#include <algorithm>
 
 #define VMA_IMPLEMENTATION
 
@@ -52,6 +54,7 @@ VmaBuffer* MemoryHelper::createBuffer(size_t size, vk::BufferUsageFlags usage, V
 
 void MemoryHelper::uploadToBuffer(VmaBuffer* buffer, void* src)
 {
+    PL_PROFILE_ZONE("MemoryHelper::uploadToBuffer");
     auto staging = createStagingBuffer(buffer->size);
 
     void* data;
@@ -71,17 +74,19 @@ void MemoryHelper::uploadToBuffer(VmaBuffer* buffer, void* src)
     engine_->endOneTimeCommandBuffer(*cmd);
 
     vmaDestroyBuffer(allocator_, staging->buffer, staging->allocation);
+    delete staging;
 }
 
 void MemoryHelper::uploadToBufferDirect(VmaBuffer* buffer, void* src)
 {
+    PL_PROFILE_ZONE("MemoryHelper::uploadToBufferDirect");
     void* data;
     vmaMapMemory(allocator_, buffer->allocation, &data);
     memcpy(data, src, buffer->size);
     vmaUnmapMemory(allocator_, buffer->allocation);
 }
 
-VmaImage* MemoryHelper::createImage(vk::Extent3D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels, vk::SampleCountFlagBits samples)
+VmaImage* MemoryHelper::createImage(vk::Extent3D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels, vk::SampleCountFlagBits samples, uint32_t arrayLayers)
 {
     VkImageCreateInfo imageInfo {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -89,7 +94,7 @@ VmaImage* MemoryHelper::createImage(vk::Extent3D extent, vk::Format format, vk::
         .format = (VkFormat)format,
         .extent = extent,
         .mipLevels = mipLevels,
-        .arrayLayers = 1,
+        .arrayLayers = arrayLayers,
         .samples = (VkSampleCountFlagBits)samples,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
         .usage = (VkImageUsageFlags)usage
@@ -106,6 +111,7 @@ VmaImage* MemoryHelper::createImage(vk::Extent3D extent, vk::Format format, vk::
 
 VmaImage* MemoryHelper::createTextureImage(const void* src, size_t size, vk::Extent3D extent, uint32_t mipLevels)
 {
+    PL_PROFILE_ZONE("MemoryHelper::createTextureImage");
     // upload to staging
     auto staging = createStagingBuffer(size);
     void* data;
@@ -201,11 +207,12 @@ VmaImage* MemoryHelper::createTextureImage(const void* src, size_t size, vk::Ext
     }
     engine_->endOneTimeCommandBuffer(*cmd);
     vmaDestroyBuffer(allocator_, staging->buffer, staging->allocation);
+    delete staging;
 
     return texture;
 }
 
-vk::UniqueImageView MemoryHelper::createImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t mipLevels)
+vk::UniqueImageView MemoryHelper::createImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t mipLevels, uint32_t baseMipLevel)
 {
     vk::ImageViewCreateInfo imageViewInfo {
         .image = image,
@@ -213,7 +220,7 @@ vk::UniqueImageView MemoryHelper::createImageViewUnique(vk::Image image, vk::For
         .format = format,
         .subresourceRange {
             .aspectMask = aspectMask,
-            .baseMipLevel = 0,
+            .baseMipLevel = baseMipLevel,
             .levelCount = mipLevels,
             .baseArrayLayer = 0,
             .layerCount = 1 }
@@ -222,6 +229,23 @@ vk::UniqueImageView MemoryHelper::createImageViewUnique(vk::Image image, vk::For
     return device_.createImageViewUnique(imageViewInfo);
 }
 
+vk::UniqueImageView MemoryHelper::createArrayImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t baseArrayLayer, uint32_t layerCount)
+{
+    vk::ImageViewCreateInfo imageViewInfo {
+        .image = image,
+        .viewType = vk::ImageViewType::e2DArray,
+        .format = format,
+        .subresourceRange {
+            .aspectMask = aspectMask,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = baseArrayLayer,
+            .layerCount = layerCount }
+    };
+
+    return device_.createImageViewUnique(imageViewInfo);
+}
+
 vk::UniqueSampler MemoryHelper::createTextureSamplerUnique(uint32_t mipLevels)
 {
     vk::SamplerCreateInfo samplerInfo {
@@ -245,6 +269,20 @@ vk::UniqueSampler MemoryHelper::createTextureSamplerUnique(uint32_t mipLevels)
     return device_.createSamplerUnique(samplerInfo);
 }
 
+void MemoryHelper::destroyBuffer(VmaBuffer* buffer)
+{
+    buffers_.erase(std::remove(buffers_.begin(), buffers_.end(), buffer), buffers_.end());
+    vmaDestroyBuffer(allocator_, buffer->buffer, buffer->allocation);
+    delete buffer;
+}
+
+void MemoryHelper::destroyImage(VmaImage* image)
+{
+    images_.erase(std::remove(images_.begin(), images_.end(), image), images_.end());
+    vmaDestroyImage(allocator_, image->image, image->allocation);
+    delete image;
+}
+
 VmaBuffer* MemoryHelper::createStagingBuffer(size_t size)
 {
     VkBufferCreateInfo stagingBufferInfo {
@@ -34,10 +34,14 @@ public:
     VmaBuffer* createBuffer(size_t size, vk::BufferUsageFlags usage, VmaAllocationCreateFlags flags);
     void uploadToBuffer(VmaBuffer* buffer, void* src);
     void uploadToBufferDirect(VmaBuffer* buffer, void* src);
-    VmaImage* createImage(vk::Extent3D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels, vk::SampleCountFlagBits samples);
+    VmaImage* createImage(vk::Extent3D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels, vk::SampleCountFlagBits samples, uint32_t arrayLayers = 1);
     VmaImage* createTextureImage(const void* src, size_t size, vk::Extent3D extent, uint32_t mipLevels);
-    vk::UniqueImageView createImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t);
+    vk::UniqueImageView createImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t mipLevels, uint32_t baseMipLevel = 0);
+    vk::UniqueImageView createArrayImageViewUnique(vk::Image image, vk::Format format, vk::ImageAspectFlagBits aspectMask, uint32_t baseArrayLayer, uint32_t layerCount);
     vk::UniqueSampler createTextureSamplerUnique(uint32_t mipLevels);
+    // frees before teardown, for short lived allocations
+    void destroyBuffer(VmaBuffer* buffer);
+    void destroyImage(VmaImage* image);
 
 private:
     VmaBuffer* createStagingBuffer(size_t size);
@@ -1,18 +1,27 @@
 #include "parser.hpp"
 
+#include <cstring>
+
 namespace pl {
 
 Parser::Parser(int argc, const char* argv[])
 {
-    for (size_t i = 1; i < argc; i += 2) {
+    for (size_t i = 1; i + 1 < argc; i += 2) {
         args[argv[i]] = argv[i + 1];
     }
     return;
 }
 
-const char* Parser::arg(const char* flag)
+const char* Parser::arg(const char* flag, const char* fallback)
+{
+    auto it = args.find(flag);
+    return it != args.end() ? it->second : fallback;
+}
+
+bool Parser::flag(const char* flag)
 {
-    return args.find(flag)->second;
+    auto value = arg(flag);
+    return value != nullptr && strcmp(value, "0") != 0;
 }
 
 const char* Parser::gltf_path()
@@ -11,12 +11,37 @@ public:
     Parser() = default;
     Parser(int argc, const char* argv[]);
 
-    const char* arg(const char* flag);
+    const char* arg(const char* flag, const char* fallback = nullptr);
+    bool flag(const char* flag);
     const char* gltf_path();
 
 private:
     const std::vector<const char*> m_flags {
         "-g",
+        "-gpu",
+        "-occlusion",
+        "-prepass",
+        "-shadows",
+        "-shadowfilter",
+        "-headless",
+        "-frames",
+        "-benchmark",
+        "-warmup",
+        "-report",
+        "-budget",
+        "-trace",
+        "-stress",
+        "-instances",
+        "-meshes",
+        "-materials",
+        "-texturesize",
+        "-depth",
+        "-density",
+        "-seed",
+        "-lights",
+        "-scale",
+        "-governor",
+        "-aa",
     };
 
     std::map<std::string, const char*> args;
@@ -0,0 +1,117 @@
+#include "pipeline_cache.hpp"
+
+#include "log.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace pl {
+
+PipelineCache::PipelineCache(const PipelineCacheCreateInfo& createInfo)
+    : device_(createInfo.device)
+    , properties_(createInfo.physicalDevice.getProperties())
+{
+    char name[64];
+    snprintf(name, sizeof(name), "pipeline_cache_%04x_%04x.bin", properties_.vendorID, properties_.deviceID);
+    path_ = (std::filesystem::path(createInfo.directory) / name).string();
+
+    std::vector<char> file;
+    std::ifstream stream(path_, std::ios::ate | std::ios::binary);
+    if (stream.is_open()) {
+        file.resize(static_cast<size_t>(stream.tellg()));
+        stream.seekg(0);
+        stream.read(file.data(), static_cast<std::streamsize>(file.size()));
+        if (!stream)
+            file.clear();
+    }
+
+    vk::PipelineCacheCreateInfo cacheInfo {};
+    if (isValid(file)) {
+        cacheInfo.initialDataSize = file.size() - sizeof(FileHeader);
+        cacheInfo.pInitialData = file.data() + sizeof(FileHeader);
+    } else if (!file.empty()) {
+        LOG_WARN("Discarding stale or corrupt pipeline cache.", "GFX");
+    }
+
+    cache_ = device_.createPipelineCacheUnique(cacheInfo);
+}
+
+void PipelineCache::save() const
+{
+    std::vector<uint8_t> data = device_.getPipelineCacheData(*cache_);
+    FileHeader header = makeHeader(data.size());
+
+    std::string tempPath = path_ + ".tmp";
+    {
+        std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) {
+            LOG_WARN("Failed to write pipeline cache.", "GFX");
+            return;
+        }
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!stream) {
+            LOG_WARN("Failed to write pipeline cache.", "GFX");
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path_, error);
+    if (error)
+        LOG_WARN("Failed to replace pipeline cache.", "GFX");
+}
+
+PipelineCache::FileHeader PipelineCache::makeHeader(uint64_t dataSize) const
+{
+    FileHeader header {
+        .magic = sMagic_,
+        .version = sVersion_,
+        .vendorID = properties_.vendorID,
+        .deviceID = properties_.deviceID,
+        .driverVersion = properties_.driverVersion,
+        .reserved = 0,
+        .dataSize = dataSize
+    };
+    std::memcpy(header.pipelineCacheUUID, properties_.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    return header;
+}
+
+bool PipelineCache::isValid(const std::vector<char>& file) const
+{
+    if (file.size() < sizeof(FileHeader))
+        return false;
+
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    FileHeader expected = makeHeader(file.size() - sizeof(FileHeader));
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+
+    // the driver's own header, checked again so a truncated blob never reaches the driver
+    struct {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    } driverHeader;
+    if (header.dataSize < sizeof(driverHeader))
+        return false;
+    std::memcpy(&driverHeader, file.data() + sizeof(FileHeader), sizeof(driverHeader));
+
+    return driverHeader.headerSize >= sizeof(driverHeader)
+        && driverHeader.headerSize <= header.dataSize
+        && driverHeader.headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+        && driverHeader.vendorID == properties_.vendorID
+        && driverHeader.deviceID == properties_.deviceID
+        && std::memcmp(driverHeader.pipelineCacheUUID, properties_.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+UniquePipelineCache createPipelineCacheUnique(const PipelineCacheCreateInfo& createInfo)
+{
+    return std::make_unique<PipelineCache>(createInfo);
+}
+
+}
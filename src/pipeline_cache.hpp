@@ -0,0 +1,56 @@
+#pragma once
+
+#include "types.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pl {
+
+struct PipelineCacheCreateInfo {
+    vk::PhysicalDevice physicalDevice;
+    vk::Device device;
+    // the file name is derived from the device, one cache per gpu
+    std::string directory;
+};
+
+// vk::PipelineCache persisted between runs.
+// A file written by another device, driver or build is discarded and the cache starts empty.
+class PipelineCache {
+public:
+    explicit PipelineCache(const PipelineCacheCreateInfo& createInfo);
+
+    vk::PipelineCache get() const { return *cache_; }
+    // written to a temporary file first, a crash mid-save leaves the previous cache intact
+    void save() const;
+
+private:
+    // prepended to the driver data
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint32_t reserved;
+        uint64_t dataSize;
+    };
+
+    static constexpr uint32_t sMagic_ = 0x43504c50; // "PLPC"
+    static constexpr uint32_t sVersion_ = 1;
+
+    FileHeader makeHeader(uint64_t dataSize) const;
+    bool isValid(const std::vector<char>& file) const;
+
+    vk::Device device_;
+    vk::PhysicalDeviceProperties properties_;
+    std::string path_;
+    vk::UniquePipelineCache cache_;
+};
+
+using UniquePipelineCache = std::unique_ptr<PipelineCache>;
+
+UniquePipelineCache createPipelineCacheUnique(const PipelineCacheCreateInfo& createInfo);
+
+}
@@ -0,0 +1,151 @@
+#include "profiler.hpp"
+
+#include "log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pl {
+
+namespace {
+
+// relaxed atomics, the trace writer reads slots the owning thread may be overwriting
+struct Zone {
+    std::atomic<const char*> name;
+    std::atomic<int64_t> start;
+    std::atomic<int64_t> end;
+};
+
+// single producer, the owning thread claims a slot in reserved before writing it and publishes
+// it with a release store of head, a reader drops every slot claimed again while it copied
+struct ThreadBuffer {
+    uint32_t threadId;
+    std::atomic<uint64_t> reserved { 0 };
+    std::atomic<uint64_t> head { 0 };
+    std::unique_ptr<Zone[]> zones { new Zone[Profiler::sZonesPerThread] };
+};
+
+struct Registry {
+    std::mutex mutex;
+    // a buffer outlives its thread so its zones can still be written out, then goes to the
+    // next new thread, short lived threads reuse the same few buffers
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<ThreadBuffer*> freeBuffers;
+};
+
+Registry& registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+// returns the buffer to the free list when its thread exits
+struct BufferLease {
+    ThreadBuffer* buffer;
+
+    BufferLease()
+    {
+        Registry& shared = registry();
+        std::lock_guard lock(shared.mutex);
+        if (!shared.freeBuffers.empty()) {
+            buffer = shared.freeBuffers.back();
+            shared.freeBuffers.pop_back();
+            return;
+        }
+        shared.buffers.push_back(std::make_unique<ThreadBuffer>());
+        shared.buffers.back()->threadId = static_cast<uint32_t>(shared.buffers.size() - 1);
+        buffer = shared.buffers.back().get();
+    }
+
+    ~BufferLease()
+    {
+        Registry& shared = registry();
+        std::lock_guard lock(shared.mutex);
+        shared.freeBuffers.push_back(buffer);
+    }
+};
+
+ThreadBuffer& threadBuffer()
+{
+    thread_local BufferLease lease;
+    return *lease.buffer;
+}
+
+}
+
+int64_t Profiler::now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const char* name, int64_t start, int64_t end)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.reserved.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Zone& zone = buffer.zones[head % sZonesPerThread];
+    zone.name.store(name, std::memory_order_relaxed);
+    zone.start.store(start, std::memory_order_relaxed);
+    zone.end.store(end, std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        LOG_ERROR("Failed to write profiler trace.", "PROFILE");
+        return false;
+    }
+
+    Registry& shared = registry();
+    std::lock_guard lock(shared.mutex);
+
+    stream << "{\"traceEvents\":[\n";
+    bool isFirst = true;
+    char line[256];
+    struct ZoneCopy {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+    std::vector<ZoneCopy> copies;
+    for (const auto& _buffer : shared.buffers) {
+        // copy the published zones, then keep those no slot claimed since has overwritten
+        uint64_t head = _buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > sZonesPerThread ? head - sZonesPerThread : 0;
+        copies.clear();
+        for (uint64_t i = first; i < head; i++) {
+            const Zone& zone = _buffer->zones[i % sZonesPerThread];
+            copies.push_back({ zone.name.load(std::memory_order_relaxed), zone.start.load(std::memory_order_relaxed), zone.end.load(std::memory_order_relaxed) });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t reserved = _buffer->reserved.load(std::memory_order_relaxed);
+        uint64_t valid = reserved > sZonesPerThread ? reserved - sZonesPerThread : 0;
+
+        for (uint64_t i = std::max(first, valid); i < head; i++) {
+            const ZoneCopy& zone = copies[i - first];
+            snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                isFirst ? "" : ",\n", zone.name, _buffer->threadId, (double)zone.start / 1000.0, (double)(zone.end - zone.start) / 1000.0);
+            stream << line;
+            isFirst = false;
+        }
+    }
+    stream << "\n]}\n";
+
+    if (!stream) {
+        LOG_ERROR("Failed to write profiler trace.", "PROFILE");
+        return false;
+    }
+    LOG_INFO(("Wrote profiler trace " + path).c_str(), "PROFILE");
+    return true;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// PL_PROFILE_ZONE("name") times the enclosing scope, the name must be a string literal.
+// Without PL_PROFILE the macro expands to nothing and no zone is recorded.
+#ifdef PL_PROFILE
+#define PL_PROFILE_CONCAT_(a, b) a##b
+#define PL_PROFILE_CONCAT(a, b) PL_PROFILE_CONCAT_(a, b)
+#define PL_PROFILE_ZONE(name) pl::ProfileZone PL_PROFILE_CONCAT(profileZone_, __LINE__)(name)
+#else
+#define PL_PROFILE_ZONE(name)
+#endif
+
+namespace pl {
+
+// Cpu zones recorded into a fixed ring buffer per thread, the oldest zones are overwritten.
+// Recording takes no locks, a thread only takes one the first time it records to register its buffer.
+namespace Profiler {
+    constexpr uint32_t sZonesPerThread = 1 << 16;
+
+    // nanoseconds since the first call
+    int64_t now();
+    void record(const char* name, int64_t start, int64_t end);
+    // chrome://tracing and Perfetto trace event JSON of every zone still in the buffers
+    bool writeChromeTrace(const std::string& path);
+}
+
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* name)
+        : name_(name)
+        , start_(Profiler::now())
+    {
+    }
+    ~ProfileZone() { Profiler::record(name_, start_, Profiler::now()); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name_;
+    int64_t start_;
+};
+
+}
@@ -0,0 +1,91 @@
+#include "shadow.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace pl {
+
+ShadowCascades fitShadowCascades(const ShadowCascadesCreateInfo& createInfo)
+{
+    constexpr uint32_t count = ShadowCascades::sCount;
+    const Camera& camera = *createInfo.camera;
+    ShadowCascades cascades {};
+
+    // practical split scheme, blends uniform and logarithmic splits
+    float nearClip = camera.znear;
+    float farClip = std::min(camera.zfar, createInfo.distance);
+    std::array<float, count + 1> splits;
+    splits[0] = nearClip;
+    for (uint32_t i = 1; i <= count; i++) {
+        float p = static_cast<float>(i) / count;
+        float logSplit = nearClip * std::pow(farClip / nearClip, p);
+        float uniformSplit = nearClip + (farClip - nearClip) * p;
+        splits[i] = uniformSplit + (logSplit - uniformSplit) * createInfo.splitLambda;
+        cascades.splits[i - 1] = splits[i];
+    }
+
+    // every cascade shares the light rotation, only the ortho bounds differ
+    glm::vec3 lightDir = glm::normalize(createInfo.lightDir);
+    glm::vec3 up = std::abs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -lightDir, up);
+
+    // every cascade spans the scene in depth, casters between the light and a cascade
+    // still shadow it and the range doesn't follow the camera
+    glm::vec3 sceneCenter = 0.5f * (createInfo.sceneMin + createInfo.sceneMax);
+    float sceneRadius = 0.5f * glm::length(createInfo.sceneMax - createInfo.sceneMin);
+    float sceneDepth = glm::vec3(lightView * glm::vec4(sceneCenter, 1.0f)).z;
+
+    glm::mat4 invView = glm::inverse(camera.view);
+    // view space half extent of the frustum at unit depth
+    glm::vec2 tanHalf { 1.0f / camera.proj[0][0], 1.0f / camera.proj[1][1] };
+
+    glm::vec3 casterMin { std::numeric_limits<float>::max() };
+    glm::vec3 casterMax { std::numeric_limits<float>::lowest() };
+
+    for (uint32_t i = 0; i < count; i++) {
+        std::array<glm::vec3, 8> corners;
+        glm::vec3 center { 0.0f };
+        for (uint32_t j = 0; j < 8; j++) {
+            float depth = splits[i + (j >> 2)];
+            glm::vec4 corner { (j & 1 ? 1.0f : -1.0f) * tanHalf.x * depth, (j & 2 ? 1.0f : -1.0f) * tanHalf.y * depth, -depth, 1.0f };
+            corners[j] = glm::vec3(invView * corner);
+            center += corners[j] / 8.0f;
+        }
+
+        // the sphere only depends on the projection, not on where the camera looks
+        float radius = 0.0f;
+        for (const auto& _corner : corners) {
+            radius = std::max(radius, glm::length(_corner - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // padded so the sphere stays covered while the center moves in steps of an eighth
+        // of the extent, the cascade keeps its matrix until the camera crosses a step
+        float extent = radius * 16.0f / 15.0f;
+        float texelSize = 2.0f * extent / static_cast<float>(createInfo.resolution);
+        float step = texelSize * static_cast<float>(std::max(createInfo.resolution / 16, 1u));
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::round(lightCenter.x / step) * step;
+        lightCenter.y = std::round(lightCenter.y / step) * step;
+
+        glm::vec3 boundsMin = lightCenter - glm::vec3(extent);
+        glm::vec3 boundsMax = lightCenter + glm::vec3(extent);
+        boundsMin.z = sceneDepth - sceneRadius;
+        boundsMax.z = sceneDepth + sceneRadius;
+
+        // light space looks down -z, ortho near and far are distances along it
+        glm::mat4 proj = glm::ortho(boundsMin.x, boundsMax.x, boundsMin.y, boundsMax.y, -boundsMax.z, -boundsMin.z);
+        cascades.viewProj[i] = proj * lightView;
+
+        casterMin = glm::min(casterMin, boundsMin);
+        casterMax = glm::max(casterMax, boundsMax);
+    }
+
+    glm::mat4 casterProj = glm::ortho(casterMin.x, casterMax.x, casterMin.y, casterMax.y, -casterMax.z, -casterMin.z);
+    cascades.casterViewProj = casterProj * lightView;
+
+    return cascades;
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "camera.hpp"
+#include "types.hpp"
+#include <array>
+
+namespace pl {
+
+// directional light shadow cascades, each fitted to a slice of the camera frustum
+struct ShadowCascades {
+    static constexpr uint32_t sCount = 4;
+
+    std::array<glm::mat4, sCount> viewProj;
+    // view space far distance of each cascade
+    glm::vec4 splits;
+    // covers every cascade, culls casters drawn to all of them at once
+    glm::mat4 casterViewProj;
+};
+
+// shadow map filter kernel, a specialization constant of the color fragment shader
+enum class ShadowFilter : uint32_t {
+    Pcf4,
+    Pcf9,
+    Poisson
+};
+
+struct ShadowCascadesCreateInfo {
+    const Camera* camera;
+    // towards the light
+    glm::vec3 lightDir;
+    glm::vec3 sceneMin;
+    glm::vec3 sceneMax;
+    uint32_t resolution;
+    // shadows end at min(zfar, distance)
+    float distance;
+    // 0 uniform splits, 1 logarithmic splits
+    float splitLambda;
+};
+
+// bounding sphere fit, moved in coarse whole texel steps so cascades don't shimmer and
+// their matrices, and the cached map, hold while the camera moves within a step
+ShadowCascades fitShadowCascades(const ShadowCascadesCreateInfo& createInfo);
+
+}
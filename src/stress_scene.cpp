@@ -0,0 +1,239 @@
+#include "stress_scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace pl {
+
+namespace {
+
+// appends raw data to the single buffer and returns its view
+int addBufferView(tinygltf::Model& model, const void* data, size_t size, int target)
+{
+    auto& buffer = model.buffers[0].data;
+    // accessors need their offsets aligned to the component size
+    buffer.resize((buffer.size() + 3) & ~size_t(3));
+
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = buffer.size();
+    bufferView.byteLength = size;
+    bufferView.target = target;
+
+    buffer.resize(buffer.size() + size);
+    memcpy(buffer.data() + bufferView.byteOffset, data, size);
+    model.bufferViews.push_back(bufferView);
+    return static_cast<int>(model.bufferViews.size() - 1);
+}
+
+int addAccessor(tinygltf::Model& model, int bufferView, int componentType, int type, size_t count)
+{
+    tinygltf::Accessor accessor;
+    accessor.bufferView = bufferView;
+    accessor.componentType = componentType;
+    accessor.type = type;
+    accessor.count = count;
+    model.accessors.push_back(accessor);
+    return static_cast<int>(model.accessors.size() - 1);
+}
+
+// uv ellipsoid, poles included
+void addMesh(tinygltf::Model& model, uint32_t index, uint32_t density, int material, std::mt19937& random)
+{
+    std::uniform_real_distribution<float> radius(0.3f, 1.0f);
+    float rx = radius(random), ry = radius(random), rz = radius(random);
+    uint32_t segments = std::max(density, 3u);
+    uint32_t rings = std::max(density / 2, 2u);
+
+    std::vector<float> positions, normals, texCoords;
+    for (uint32_t ring = 0; ring <= rings; ring++) {
+        float v = (float)ring / (float)rings;
+        float phi = v * 3.14159265f;
+        for (uint32_t segment = 0; segment <= segments; segment++) {
+            float u = (float)segment / (float)segments;
+            float theta = u * 2.0f * 3.14159265f;
+            float x = std::sin(phi) * std::cos(theta), y = std::cos(phi), z = std::sin(phi) * std::sin(theta);
+            positions.insert(positions.end(), { x * rx, y * ry, z * rz });
+
+            // gradient of the ellipsoid
+            float nx = x / rx, ny = y / ry, nz = z / rz;
+            float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+            normals.insert(normals.end(), { nx / length, ny / length, nz / length });
+            texCoords.insert(texCoords.end(), { u * 4.0f, v * 2.0f });
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        for (uint32_t segment = 0; segment < segments; segment++) {
+            uint32_t a = ring * (segments + 1) + segment;
+            uint32_t b = a + segments + 1;
+            if (ring > 0)
+                indices.insert(indices.end(), { a, a + 1, b });
+            if (ring + 1 < rings)
+                indices.insert(indices.end(), { a + 1, b + 1, b });
+        }
+    }
+
+    size_t vertexCount = positions.size() / 3;
+    int positionAccessor = addAccessor(model, addBufferView(model, positions.data(), positions.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+    model.accessors[positionAccessor].minValues = { -rx, -ry, -rz };
+    model.accessors[positionAccessor].maxValues = { rx, ry, rz };
+
+    tinygltf::Primitive primitive;
+    primitive.attributes["POSITION"] = positionAccessor;
+    primitive.attributes["NORMAL"] = addAccessor(model, addBufferView(model, normals.data(), normals.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+    primitive.attributes["TEXCOORD_0"] = addAccessor(model, addBufferView(model, texCoords.data(), texCoords.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount);
+    primitive.indices = addAccessor(model, addBufferView(model, indices.data(), indices.size() * sizeof(uint32_t), TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER), TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, indices.size());
+    primitive.material = material;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+
+    tinygltf::Mesh mesh;
+    mesh.name = "stress_mesh_" + std::to_string(index);
+    mesh.primitives.push_back(primitive);
+    model.meshes.push_back(mesh);
+}
+
+// rgba checker board, two shades of a random hue
+void addMaterial(tinygltf::Model& model, uint32_t index, uint32_t size, std::mt19937& random)
+{
+    std::uniform_int_distribution<int> channel(64, 255);
+    unsigned char color[3] = { (unsigned char)channel(random), (unsigned char)channel(random), (unsigned char)channel(random) };
+
+    tinygltf::Image image;
+    image.name = "stress_texture_" + std::to_string(index);
+    image.width = static_cast<int>(size);
+    image.height = static_cast<int>(size);
+    image.component = 4;
+    image.bits = 8;
+    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    image.image.resize(size_t(size) * size * 4);
+    uint32_t cell = std::max(size / 8, 1u);
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            bool isDark = ((x / cell) + (y / cell)) % 2 == 1;
+            unsigned char* pixel = &image.image[(size_t(y) * size + x) * 4];
+            for (int c = 0; c < 3; c++)
+                pixel[c] = isDark ? color[c] / 2 : color[c];
+            pixel[3] = 255;
+        }
+    }
+    model.images.push_back(image);
+
+    tinygltf::Texture texture;
+    texture.source = static_cast<int>(model.images.size() - 1);
+    model.textures.push_back(texture);
+
+    tinygltf::Material material;
+    material.name = "stress_material_" + std::to_string(index);
+    material.pbrMetallicRoughness.baseColorTexture.index = static_cast<int>(model.textures.size() - 1);
+    model.materials.push_back(material);
+}
+
+// splits [first, first + count) over the remaining levels, instances are the deepest nodes
+int addGroup(tinygltf::Model& model, const std::vector<int>& leaves, size_t first, size_t count, uint32_t levels)
+{
+    tinygltf::Node group;
+    group.name = "stress_group";
+    if (levels <= 1) {
+        group.children.assign(leaves.begin() + first, leaves.begin() + first + count);
+    } else {
+        // about the same fan out on every level
+        size_t fanOut = std::max<size_t>(2, static_cast<size_t>(std::ceil(std::pow((double)count, 1.0 / (double)levels))));
+        size_t chunk = (count + fanOut - 1) / fanOut;
+        for (size_t i = first; i < first + count; i += chunk) {
+            group.children.push_back(addGroup(model, leaves, i, std::min(chunk, first + count - i), levels - 1));
+        }
+    }
+    model.nodes.push_back(group);
+    return static_cast<int>(model.nodes.size() - 1);
+}
+
+}
+
+tinygltf::Model generateStressScene(const StressSceneCreateInfo& createInfo)
+{
+    std::mt19937 random(createInfo.seed);
+    tinygltf::Model model;
+    model.buffers.resize(1);
+
+    uint32_t materialCount = std::max(createInfo.materialCount, 1u);
+    for (uint32_t i = 0; i < materialCount; i++) {
+        addMaterial(model, i, std::max(createInfo.textureSize, 1u), random);
+    }
+
+    uint32_t meshCount = std::max(createInfo.meshCount, 1u);
+    for (uint32_t i = 0; i < meshCount; i++) {
+        addMesh(model, i, createInfo.density, static_cast<int>(i % materialCount), random);
+    }
+
+    // instances on a square grid with some jitter, about two units apart
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt((double)createInfo.instanceCount)));
+    float spacing = 2.5f;
+    float offset = 0.5f * spacing * (float)side;
+    std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> angle(0.0f, 2.0f * 3.14159265f);
+    std::uniform_real_distribution<float> scale(0.6f, 1.2f);
+    std::uniform_int_distribution<uint32_t> mesh(0, meshCount - 1);
+
+    std::vector<int> leaves;
+    leaves.reserve(createInfo.instanceCount);
+    for (uint32_t i = 0; i < createInfo.instanceCount; i++) {
+        tinygltf::Node node;
+        node.name = "stress_instance_" + std::to_string(i);
+        node.mesh = static_cast<int>(mesh(random));
+        node.translation = {
+            (double)((float)(i % side) * spacing - offset + jitter(random)),
+            (double)(jitter(random) + 1.0f),
+            (double)((float)(i / side) * spacing - offset + jitter(random))
+        };
+        float halfAngle = 0.5f * angle(random);
+        node.rotation = { 0.0, (double)std::sin(halfAngle), 0.0, (double)std::cos(halfAngle) };
+        float s = scale(random);
+        node.scale = { (double)s, (double)s, (double)s };
+        model.nodes.push_back(node);
+        leaves.push_back(static_cast<int>(model.nodes.size() - 1));
+    }
+
+    tinygltf::Scene scene;
+    scene.name = "stress";
+    if (createInfo.hierarchyDepth <= 1 || leaves.empty())
+        scene.nodes = leaves;
+    else
+        scene.nodes.push_back(addGroup(model, leaves, 0, leaves.size(), createInfo.hierarchyDepth - 1));
+
+    // a few units above the instances, every fourth a spot aimed at the ground
+    std::uniform_real_distribution<float> position(-offset, offset);
+    std::uniform_real_distribution<float> height(2.0f, 5.0f);
+    std::uniform_real_distribution<float> hue(0.2f, 1.0f);
+    std::uniform_real_distribution<float> range(4.0f, 10.0f);
+    for (uint32_t i = 0; i < createInfo.lightCount; i++) {
+        tinygltf::Light light;
+        light.name = "stress_light_" + std::to_string(i);
+        light.type = i % 4 == 3 ? "spot" : "point";
+        light.color = { (double)hue(random), (double)hue(random), (double)hue(random) };
+        light.intensity = 4.0;
+        light.range = (double)range(random);
+        light.spot.innerConeAngle = 0.3;
+        light.spot.outerConeAngle = 0.6;
+        model.lights.push_back(light);
+
+        tinygltf::Node node;
+        node.name = light.name;
+        node.light = static_cast<int>(model.lights.size() - 1);
+        node.translation = { (double)position(random), (double)height(random), (double)position(random) };
+        // -z turned straight down
+        node.rotation = { -0.7071068, 0.0, 0.0, 0.7071068 };
+        model.nodes.push_back(node);
+        scene.nodes.push_back(static_cast<int>(model.nodes.size() - 1));
+    }
+    model.scenes.push_back(scene);
+    model.defaultScene = 0;
+
+    return model;
+}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "tiny_gltf.h"
+#include <cstdint>
+
+namespace pl {
+
+struct StressSceneCreateInfo {
+    // placed meshes, each one a draw
+    uint32_t instanceCount { 10000 };
+    uint32_t meshCount { 64 };
+    // one base color texture per material, mesh i uses material i % materialCount
+    uint32_t materialCount { 16 };
+    uint32_t textureSize { 256 };
+    // levels of nodes above and including each instance, 1 puts every instance at the root
+    uint32_t hierarchyDepth { 1 };
+    // segments around each mesh, a mesh has about density^2 triangles
+    uint32_t density { 16 };
+    // point and spot lights scattered over the grid, KHR_lights_punctual nodes
+    uint32_t lightCount { 0 };
+    uint32_t seed { 1 };
+};
+
+// Builds a glTF scene in memory for scaling tests: ellipsoid meshes of varying proportions,
+// checker textures, instances and lights scattered over a square grid, loaded like any parsed file.
+tinygltf::Model generateStressScene(const StressSceneCreateInfo& createInfo);
+
+}